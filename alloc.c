@@ -0,0 +1,210 @@
+/*
+ * the allocator used by the Lua VM.
+ *
+ * most of what lurch allocates is small and short-lived: the tables
+ * and strings that make up each parsed message, the history entries,
+ * the strings built while formatting the screen, and so on. blocks of
+ * up to ALLOC_SMALL bytes are rounded up to a multiple of ALLOC_CLASS
+ * bytes and carved out of ALLOC_CHUNK-sized chunks; when freed, they're
+ * put on a freelist for their size class and reused, instead of going
+ * back and forth to malloc. larger blocks are passed straight through.
+ *
+ * every block is prefixed with a small header recording the "phase"
+ * that was current when it was allocated (parsing, handling events,
+ * rendering, or adding to the history; see alloc_setphase), so that
+ * we can tell which part of lurch is holding on to memory.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "alloc.h"
+
+#define ALLOC_CLASS    16
+#define ALLOC_SMALL    256
+#define ALLOC_NCLASSES (ALLOC_SMALL / ALLOC_CLASS)
+#define ALLOC_CHUNK    (64 * 1024)
+
+/*
+ * Lua only needs its blocks to be aligned for a lua_Number, a pointer,
+ * or a lua_Integer, so an eight-byte header is enough.
+ */
+union alloc_hdr {
+	uint8_t  phase;
+	uint64_t align;
+};
+
+#define HDRSZ sizeof(union alloc_hdr)
+
+/* freed small blocks, linked through their first bytes */
+struct alloc_free {
+	struct alloc_free *next;
+};
+
+const char *alloc_phase_names[ALLOC_NPHASES] = {
+	[ALLOC_OTHER]    = "other",
+	[ALLOC_PARSE]    = "parse",
+	[ALLOC_HANDLERS] = "handlers",
+	[ALLOC_RENDER]   = "render",
+	[ALLOC_HISTORY]  = "history",
+};
+
+static enum alloc_phase phase = ALLOC_OTHER;
+static struct alloc_stats stats;
+
+static struct alloc_free *freelists[ALLOC_NCLASSES];
+static char *chunk = NULL;         /* chunk that small blocks are carved from */
+static size_t chunk_left = 0;
+
+/* size class of a block of sz bytes (including the header), or -1 */
+static inline ssize_t
+sizeclass(size_t sz)
+{
+	if (sz > ALLOC_SMALL)
+		return -1;
+	return (ssize_t) ((sz + ALLOC_CLASS - 1) / ALLOC_CLASS) - 1;
+}
+
+static void *
+small_alloc(ssize_t cls)
+{
+	size_t sz = (size_t) (cls + 1) * ALLOC_CLASS;
+
+	if (freelists[cls]) {
+		struct alloc_free *blk = freelists[cls];
+		freelists[cls] = blk->next;
+		stats.pooled -= sz;
+		return blk;
+	}
+
+	if (chunk_left < sz) {
+		/* whatever's left of the old chunk is too small for this
+		 * block; give it to the freelist that it does fit. */
+		if (chunk_left >= ALLOC_CLASS) {
+			ssize_t rest = (ssize_t) (chunk_left / ALLOC_CLASS) - 1;
+			struct alloc_free *blk = (struct alloc_free *) chunk;
+			blk->next = freelists[rest];
+			freelists[rest] = blk;
+			stats.pooled += (size_t) (rest + 1) * ALLOC_CLASS;
+		}
+
+		if ((chunk = malloc(ALLOC_CHUNK)) == NULL) {
+			chunk_left = 0;
+			return NULL;
+		}
+		chunk_left = ALLOC_CHUNK;
+		stats.arena += ALLOC_CHUNK;
+	}
+
+	void *blk = chunk;
+	chunk += sz;
+	chunk_left -= sz;
+	return blk;
+}
+
+static void
+small_free(void *blk, ssize_t cls)
+{
+	struct alloc_free *f = blk;
+	f->next = freelists[cls];
+	freelists[cls] = f;
+	stats.pooled += (size_t) (cls + 1) * ALLOC_CLASS;
+}
+
+static void *
+block_alloc(size_t nsize)
+{
+	ssize_t cls = sizeclass(nsize + HDRSZ);
+	union alloc_hdr *hdr = cls < 0 ? malloc(nsize + HDRSZ) : small_alloc(cls);
+	if (hdr == NULL)
+		return NULL;
+
+	hdr->phase = phase;
+	stats.live[phase] += nsize;
+	stats.count[phase] += 1;
+	return hdr + 1;
+}
+
+static void
+block_free(void *ptr, size_t osize)
+{
+	union alloc_hdr *hdr = (union alloc_hdr *) ptr - 1;
+	stats.live[hdr->phase] -= osize;
+	stats.count[hdr->phase] -= 1;
+
+	ssize_t cls = sizeclass(osize + HDRSZ);
+	if (cls < 0)
+		free(hdr);
+	else
+		small_free(hdr, cls);
+}
+
+/* a lua_Alloc; see lua_newstate(3) */
+void *
+alloc_lua(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+	(void) ud;
+
+	if (nsize == 0) {
+		if (ptr) block_free(ptr, osize);
+		return NULL;
+	}
+
+	/* when ptr is NULL, osize is the type of the object being
+	 * allocated rather than a size. */
+	if (ptr == NULL)
+		return block_alloc(nsize);
+
+	union alloc_hdr *hdr = (union alloc_hdr *) ptr - 1;
+	ssize_t ocls = sizeclass(osize + HDRSZ);
+	ssize_t ncls = sizeclass(nsize + HDRSZ);
+
+	/* the block is already the right size, or is big and can be
+	 * resized in place by realloc. */
+	if (ocls >= 0 && ocls == ncls) {
+		stats.live[hdr->phase] += nsize;
+		stats.live[hdr->phase] -= osize;
+		return ptr;
+	} else if (ocls < 0 && ncls < 0) {
+		union alloc_hdr *new = realloc(hdr, nsize + HDRSZ);
+		if (new != NULL) {
+			stats.live[new->phase] += nsize;
+			stats.live[new->phase] -= osize;
+			return new + 1;
+		}
+	}
+
+	void *new = ocls < 0 && ncls < 0 ? NULL : block_alloc(nsize);
+	if (new == NULL) {
+		/*
+		 * Lua expects shrinking a block to always succeed, so
+		 * just keep the old block. it's too big for the size
+		 * class it'll be freed to, but that's harmless.
+		 */
+		if (nsize > osize)
+			return NULL;
+		stats.live[hdr->phase] += nsize;
+		stats.live[hdr->phase] -= osize;
+		return ptr;
+	}
+	memcpy(new, ptr, osize < nsize ? osize : nsize);
+	block_free(ptr, osize);
+	return new;
+}
+
+/* set the current phase, returning the previous one. */
+enum alloc_phase
+alloc_setphase(enum alloc_phase new)
+{
+	enum alloc_phase old = phase;
+	phase = new;
+	return old;
+}
+
+void
+alloc_getstats(struct alloc_stats *out)
+{
+	memcpy(out, &stats, sizeof(stats));
+}
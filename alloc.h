@@ -0,0 +1,28 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+
+enum alloc_phase {
+	ALLOC_OTHER,
+	ALLOC_PARSE,
+	ALLOC_HANDLERS,
+	ALLOC_RENDER,
+	ALLOC_HISTORY,
+	ALLOC_NPHASES,
+};
+
+struct alloc_stats {
+	size_t live[ALLOC_NPHASES];   /* bytes in use, by allocating phase */
+	size_t count[ALLOC_NPHASES];  /* blocks in use, by allocating phase */
+	size_t pooled;                /* bytes sitting in the freelists */
+	size_t arena;                 /* bytes taken from malloc for small blocks */
+};
+
+extern const char *alloc_phase_names[ALLOC_NPHASES];
+
+void *alloc_lua(void *ud, void *ptr, size_t osize, size_t nsize);
+enum alloc_phase alloc_setphase(enum alloc_phase phase);
+void alloc_getstats(struct alloc_stats *stats);
+
+#endif
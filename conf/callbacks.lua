@@ -6,6 +6,8 @@ local util      = require('util')
 local lurchconn = require('lurchconn')
 local utf8utils = require('utf8utils')
 local termbox   = require('termbox')
+local statusline = require('statusline')
+local proc      = require('proc')
 local format = string.format
 
 local M = {}
@@ -20,11 +22,16 @@ end
 -- and making the cursor visible. See fancy_promptf for a more
 -- complex example.
 --
+-- inp is the input line, and cursor is the column of the input line
+-- that the cursor is on.
+--
 -- See: callbacks.prompt
 function M.simple_promptf(inp, cursor)
     -- strip off stuff from input that can't be shown on the
-    -- screen, and show IRC formatting escape sequences nicely.
-    inp = mirc.show(inp:sub(-(tui.tty_width -1)))
+    -- screen (keeping the cursor in view), and show IRC formatting
+    -- escape sequences nicely.
+    inp, cursor = utf8utils.window(inp, cursor, tui.tty_width)
+    inp = mirc.show(inp)
 
     -- draw the input buffer and move the cursor to the appropriate
     -- position.
@@ -83,9 +90,9 @@ function M.fancy_promptf(inp, cursor)
     local rawprompt_len = utf8utils.dwidth(mirc.remove(prompt))
 
     -- strip off stuff from input that can't be shown on the
-    -- screen
-    local offset = (tui.tty_width - 1) - rawprompt_len
-    inp = inp:sub(-offset)
+    -- screen, keeping the cursor in view.
+    local offset = tui.tty_width - rawprompt_len
+    inp, cursor = utf8utils.window(inp, cursor, offset)
 
     -- show IRC formatting escape sequences nicely.
     inp = mirc.show(inp)
@@ -163,60 +170,61 @@ end
 -- Unlike simple_statusline, which is just white on black, it makes heavy use
 -- of color.
 --
+-- Each buffer's part of the statusline is rendered by fancy_segment, and
+-- kept by the statusline module until that buffer's state changes, so that
+-- the statusline can be redrawn cheaply after each new message.
+--
 -- See: callbacks.statusline
 -- [0]: https://git.causal.agency/catgirl
-function M.fancy_statusline()
-    local chanlist = ""
-    for buf = 1, #bufs do
-        local ch = bufs[buf].name
-        local bold = false
-        local unread_ind = ""
-
-        if bufs[buf].unreadl > 0 or bufs[buf].unreadh > 0 or bufs[buf].pings > 0 then
-            if bufs[buf].pings > 0 then
-                bold = true
-                if bufs[buf].unreadh > 0 then
-                    unread_ind = format("+%d,%d", bufs[buf].pings, bufs[buf].unreadh)
-                else
-                    unread_ind = format("+%d", bufs[buf].pings)
-                end
-            elseif bufs[buf].unreadh > 0 then
-                -- Uncomment the lines below if you want low-priority
-                -- events (joins, quits, etc) to show in the statusline.
-                --if bufs[buf].unreadl > 0 then
-                --    unread_ind = format("+%d (%d)", bufs[buf].unreadh, bufs[buf].unreadl)
-                --else
-                --    unread_ind = format("+%d", bufs[buf].unreadh)
-                --end
-
-                unread_ind = format("+%d", bufs[buf].unreadh)
-            elseif bufs[buf].unreadl > 0 then
-                -- Uncomment this, too, if you want low-priority events
-                -- to show in the statusline.
-                --unread_ind = format("(%d)", bufs[buf].unreadl)
+local function fancy_segment(idx, buf, current)
+    local ch = buf.name
+    local bold = false
+    local unread_ind = ""
+
+    if buf.unreadl > 0 or buf.unreadh > 0 or buf.pings > 0 then
+        if buf.pings > 0 then
+            bold = true
+            if buf.unreadh > 0 then
+                unread_ind = format("+%d,%d", buf.pings, buf.unreadh)
+            else
+                unread_ind = format("+%d", buf.pings)
             end
+        elseif buf.unreadh > 0 then
+            -- Uncomment the lines below if you want low-priority
+            -- events (joins, quits, etc) to show in the statusline.
+            --if buf.unreadl > 0 then
+            --    unread_ind = format("+%d (%d)", buf.unreadh, buf.unreadl)
+            --else
+            --    unread_ind = format("+%d", buf.unreadh)
+            --end
+
+            unread_ind = format("+%d", buf.unreadh)
+        elseif buf.unreadl > 0 then
+            -- Uncomment this, too, if you want low-priority events
+            -- to show in the statusline.
+            --unread_ind = format("(%d)", buf.unreadl)
         end
+    end
 
-        local pnch
-        if unread_ind ~= "" then
-            pnch = tui.highlight(format(" %d %s %s ", buf, ch, unread_ind),
-                ch, not bold)
-        elseif unread_ind == "" and buf == cbuf then
-            pnch = tui.highlight(format(" %d %s ", buf, ch), ch, true)
-        end
+    local pnch
+    if unread_ind ~= "" then
+        pnch = tui.highlight(format(" %d %s %s ", idx, ch, unread_ind),
+            ch, not bold)
+    elseif unread_ind == "" and current then
+        pnch = tui.highlight(format(" %d %s ", idx, ch), ch, true)
+    end
 
-        -- If there are no unread messages, don't display the buffer in the
-        -- statusline (unless it's the current buffer)
-        if buf == cbuf then
-            chanlist = format("%s\x0f\x16%s\x0f ", chanlist, pnch)
-        else
-            if pnch then
-                chanlist = format("%s%s ", chanlist, pnch)
-            end
-        end
+    -- If there are no unread messages, don't display the buffer in the
+    -- statusline (unless it's the current buffer)
+    if current then
+        return format("\x0f\x16%s\x0f ", pnch)
+    elseif pnch then
+        return format("%s ", pnch)
     end
+end
 
-    return "\x0f" .. chanlist
+function M.fancy_statusline()
+    return "\x0f" .. statusline.render(bufs, cbuf, fancy_segment)
 end
 
 -- The statusline function, the purpose of which is to print the list
@@ -247,8 +255,10 @@ M.bottom_statusline = nil
 -- event: the parsed IRC message that led to the IRC event. (See irc.lua)
 function M.on_unread(type, dest, time, left, right, event)
     if type == 2 then
-        -- Disabled by default.
-        --os.execute("notify-send All your pings are belong to us")
+        -- Disabled by default. (proc.spawn runs the command in the
+        -- background; os.execute would freeze lurch until it exits.)
+        --proc.spawn({ "notify-send", "All your pings are belong to us" },
+        --    { timeout = 5 })
     end
 end
 
@@ -69,11 +69,18 @@ M.servers = {
         --   * echo-message:   Normally, when the user sends a message, the server doesn't
         --                     let us know if the message was recieved or not. With this
         --                     enabled, the server will "echo" our messages back to us.
+        --   * batch:          Allows the server to send related messages (e.g. the
+        --                     quits from a netsplit) as a group, which lurch then
+        --                     handles all at once.
+        --   * draft/chathistory:
+        --                     After reconnecting, lurch asks the server for the
+        --                     messages it missed while disconnected. Requires batch.
         --
         -- Note that these capabilities will only be enabled if the server
         -- supports it.
         --
-        caps = { "server-time", "account-notify", "echo-message" }
+        caps = { "server-time", "account-notify", "echo-message", "batch",
+            "draft/chathistory" }
     }
 }
 
@@ -147,7 +154,8 @@ M.colors = function()
 end
 
 -- Time/date format. This is shown to the left of every message. See
--- the documentation for os.date() for info on the various format sequences.
+-- strftime(3) for info on the various format sequences (they're the same
+-- as those of Lua's os.date()).
 --
 -- When changing this, be sure to update config.time_col_width as appropriate.
 -- To disable time altogether, set this to an empty string and set the
@@ -325,6 +333,20 @@ M.handlers = {
     },
 }
 
+-- Number of lines from a buffer's log to show when it is first viewed.
+-- Set to 0 to disable.
+M.backlog = 50
+
+-- Maximum number of missed messages to ask the server for in each channel
+-- after reconnecting. (Only if the draft/chathistory capability is enabled.)
+M.chathistory_limit = 100
+
+-- Maximum number of nicknames to list when showing a netsplit or netjoin.
+M.netsplit_nicks = 10
+
+-- Maximum number of matches shown by /search and /grep.
+M.search_limit = 500
+
 -- what timezone to display times in. (format: "UTC[+-]<offset>")
 M.tz = "UTC-5:00"
 
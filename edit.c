@@ -0,0 +1,335 @@
+/*
+ * the input line editor used by rt/tbrl.lua.
+ *
+ * the text is kept in a gap buffer: the bytes before the cursor are at
+ * the start of buf, the bytes after it at the end, and the space in
+ * between (the gap) is where text is inserted. typing and deleting at
+ * the cursor is therefore cheap no matter how long the line is, and
+ * moving the cursor only moves the bytes it passes over.
+ *
+ * alongside the text, we keep track of the number of codepoints before
+ * the cursor and in total, and of the display width of the text before
+ * the cursor, so that the prompt can place the terminal's cursor without
+ * having to measure the line again.
+ */
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <utf8proc.h>
+
+#include "dwidth.h"
+#include "edit.h"
+#include "util.h"
+
+#define ISCONT(CH) (((unsigned char) (CH) & 0xC0) == 0x80)
+
+/*
+ * the display width of a codepoint. control characters (i.e. IRC
+ * formatting codes) are shown as a letter in the input line (see
+ * mirc.show), so they're one column wide here.
+ */
+size_t
+edit_cpwidth(int32_t cp)
+{
+	if (cp < 0x20 || cp == 0x7F)
+		return 1;
+	if (cp < UTF8_MAX)
+		return dwidth[cp];
+	return 0;
+}
+
+/* length in bytes of the codepoint at s (invalid bytes count as one) */
+static size_t
+cpnext(const char *s, size_t n)
+{
+	size_t len = 1;
+	while (len < n && len < 4 && ISCONT(s[len]))
+		++len;
+	return len;
+}
+
+static size_t
+cpwidth(const char *s, size_t n)
+{
+	utf8proc_int32_t cp = 0;
+	if (utf8proc_iterate((const utf8proc_uint8_t *) s, (utf8proc_ssize_t) n, &cp) < 0)
+		return 1;
+	return edit_cpwidth(cp);
+}
+
+/* count the codepoints in s, and their display width. */
+static void
+measure(const char *s, size_t n, size_t *cps, size_t *width)
+{
+	*cps = 0, *width = 0;
+	for (size_t i = 0, l = 0; i < n; i += l) {
+		l = cpnext(&s[i], n - i);
+		*cps += 1, *width += cpwidth(&s[i], l);
+	}
+}
+
+size_t
+edit_strwidth(const char *s, size_t len)
+{
+	size_t cps, width;
+	measure(s, len, &cps, &width);
+	return width;
+}
+
+/* byte offset of the codepoint n codepoints before/after the cursor */
+static size_t
+offset(struct edit *e, ssize_t n)
+{
+	if (n < 0) {
+		size_t pos = e->gap;
+		for (; n < 0 && pos > 0; ++n) {
+			size_t end = pos--;
+			while (pos > 0 && ISCONT(e->buf[pos]) && end - pos < 4)
+				--pos;
+		}
+		return pos;
+	}
+
+	size_t after = e->gapend;
+	for (; n > 0 && after < e->size; --n)
+		after += cpnext(&e->buf[after], e->size - after);
+	return e->gap + (after - e->gapend);
+}
+
+static void
+grow(struct edit *e, size_t need)
+{
+	if (e->gapend - e->gap >= need)
+		return;
+
+	size_t after = e->size - e->gapend;
+	size_t size = e->size * 2;
+	if (size < e->size + need + 64)
+		size = e->size + need + 64;
+
+	if ((e->buf = realloc(e->buf, size)) == NULL)
+		die("couldn't allocate memory for the input line:");
+	memmove(&e->buf[size - after], &e->buf[e->gapend], after);
+	e->gapend = size - after;
+	e->size = size;
+}
+
+/* move the cursor (and so the gap) to a byte offset. */
+static void
+moveto(struct edit *e, size_t pos)
+{
+	size_t cps, width;
+
+	if (pos < e->gap) {
+		size_t n = e->gap - pos;
+		measure(&e->buf[pos], n, &cps, &width);
+		memmove(&e->buf[e->gapend - n], &e->buf[pos], n);
+		e->gap -= n, e->gapend -= n;
+		e->cursor -= cps, e->col -= width;
+	} else if (pos > e->gap) {
+		size_t n = pos - e->gap;
+		measure(&e->buf[e->gapend], n, &cps, &width);
+		memmove(&e->buf[e->gap], &e->buf[e->gapend], n);
+		e->gap += n, e->gapend += n;
+		e->cursor += cps, e->col += width;
+	}
+}
+
+static void
+raw_insert(struct edit *e, const char *s, size_t len)
+{
+	size_t cps, width;
+	measure(s, len, &cps, &width);
+
+	grow(e, len);
+	memcpy(&e->buf[e->gap], s, len);
+	e->gap += len;
+	e->cursor += cps, e->len += cps, e->col += width;
+}
+
+/* delete the text between the byte offsets from and to. */
+static void
+raw_delete(struct edit *e, size_t from, size_t to)
+{
+	size_t cps, width;
+
+	moveto(e, to);
+	measure(&e->buf[from], to - from, &cps, &width);
+	e->gap = from;
+	e->cursor -= cps, e->len -= cps, e->col -= width;
+}
+
+static void
+record(struct edit *e, _Bool insert, size_t pos, const char *text,
+		size_t len, size_t curs)
+{
+	/* keep typing in one go as a single step. */
+	if (insert && e->undo_count > 0) {
+		struct edit_op *last =
+			&e->undo[(e->undo_next + EDIT_UNDO - 1) % EDIT_UNDO];
+		if (last->insert && last->pos + last->len == pos
+				&& !isspace((unsigned char) text[0])) {
+			if ((last->text = realloc(last->text, last->len + len)) == NULL)
+				die("couldn't allocate memory for the input line:");
+			memcpy(&last->text[last->len], text, len);
+			last->len += len;
+			return;
+		}
+	}
+
+	struct edit_op *op = &e->undo[e->undo_next];
+	if (e->undo_count == EDIT_UNDO)
+		free(op->text);
+	else
+		++e->undo_count;
+	e->undo_next = (e->undo_next + 1) % EDIT_UNDO;
+
+	if ((op->text = malloc(len)) == NULL)
+		die("couldn't allocate memory for the input line:");
+	memcpy(op->text, text, len);
+	op->insert = insert, op->pos = pos, op->len = len, op->curs = curs;
+}
+
+static void
+clear_undo(struct edit *e)
+{
+	for (; e->undo_count > 0; --e->undo_count) {
+		e->undo_next = (e->undo_next + EDIT_UNDO - 1) % EDIT_UNDO;
+		free(e->undo[e->undo_next].text);
+	}
+}
+
+void
+edit_init(struct edit *e)
+{
+	memset(e, 0x0, sizeof(*e));
+}
+
+void
+edit_free(struct edit *e)
+{
+	clear_undo(e);
+	free(e->buf);
+	free(e->kill);
+	edit_init(e);
+}
+
+/* replace the text, and put the cursor at its end. */
+void
+edit_set(struct edit *e, const char *s, size_t len)
+{
+	clear_undo(e);
+	e->gap = 0, e->gapend = e->size;
+	e->cursor = e->len = e->col = 0;
+	raw_insert(e, s, len);
+}
+
+void
+edit_insert(struct edit *e, const char *s, size_t len)
+{
+	if (len == 0) return;
+	record(e, true, e->gap, s, len, e->gap);
+	raw_insert(e, s, len);
+}
+
+/*
+ * delete n codepoints after the cursor (or -n codepoints before it, if
+ * n is negative), and save them for edit_yank if kill is true.
+ */
+void
+edit_delete(struct edit *e, ssize_t n, _Bool kill)
+{
+	size_t curs = e->gap;
+	size_t from = n < 0 ? offset(e, n) : e->gap;
+	size_t to   = n < 0 ? e->gap : offset(e, n);
+	if (from == to) return;
+
+	/* the text after the cursor isn't contiguous with the text
+	 * before it, so bring it over first. */
+	moveto(e, to);
+	const char *text = &e->buf[from];
+	size_t len = to - from;
+
+	if (kill) {
+		if ((e->kill = realloc(e->kill, len)) == NULL)
+			die("couldn't allocate memory for the input line:");
+		memcpy(e->kill, text, len);
+		e->killlen = len;
+	}
+
+	record(e, false, from, text, len, curs);
+	raw_delete(e, from, to);
+}
+
+/* insert the text that was last killed. */
+void
+edit_yank(struct edit *e)
+{
+	if (e->kill) edit_insert(e, e->kill, e->killlen);
+}
+
+/* move the cursor by n codepoints. */
+void
+edit_move(struct edit *e, ssize_t n)
+{
+	moveto(e, offset(e, n));
+}
+
+/*
+ * the number of codepoints between the cursor and the start of the
+ * previous word (if dir is negative; the result will be negative too),
+ * or the end of the next word (if dir is positive).
+ */
+ssize_t
+edit_word(struct edit *e, int dir)
+{
+	ssize_t n = 0;
+
+	if (dir < 0) {
+		size_t pos = e->gap;
+		while (pos > 0 && isspace((unsigned char) e->buf[pos - 1]))
+			--pos, --n;
+		while (pos > 0 && !isspace((unsigned char) e->buf[pos - 1])) {
+			if (!ISCONT(e->buf[pos - 1])) --n;
+			--pos;
+		}
+	} else {
+		size_t pos = e->gapend;
+		while (pos < e->size && isspace((unsigned char) e->buf[pos]))
+			++pos, ++n;
+		while (pos < e->size && !isspace((unsigned char) e->buf[pos])) {
+			pos += cpnext(&e->buf[pos], e->size - pos);
+			++n;
+		}
+	}
+
+	return n;
+}
+
+/* undo the last change. returns false if there's nothing to undo. */
+_Bool
+edit_undo(struct edit *e)
+{
+	if (e->undo_count == 0)
+		return false;
+
+	e->undo_next = (e->undo_next + EDIT_UNDO - 1) % EDIT_UNDO;
+	--e->undo_count;
+	struct edit_op *op = &e->undo[e->undo_next];
+
+	if (op->insert) {
+		raw_delete(e, op->pos, op->pos + op->len);
+	} else {
+		moveto(e, op->pos);
+		raw_insert(e, op->text, op->len);
+	}
+	moveto(e, op->curs);
+
+	free(op->text);
+	op->text = NULL;
+	return true;
+}
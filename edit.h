@@ -0,0 +1,46 @@
+#ifndef EDIT_H
+#define EDIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define EDIT_UNDO 64
+
+struct edit_op {
+	_Bool  insert;       /* whether the text was inserted or deleted */
+	size_t pos;          /* byte offset at which that happened */
+	size_t curs;         /* byte offset of the cursor before that */
+	char  *text;
+	size_t len;
+};
+
+struct edit {
+	char  *buf;
+	size_t size;
+	size_t gap, gapend;  /* the gap, i.e. the cursor, is buf[gap..gapend) */
+	size_t cursor;       /* codepoints before the cursor */
+	size_t len;          /* codepoints in total */
+	size_t col;          /* display width of the text before the cursor */
+
+	char  *kill;         /* last text that was killed */
+	size_t killlen;
+
+	struct edit_op undo[EDIT_UNDO];
+	size_t undo_next, undo_count;
+};
+
+size_t edit_cpwidth(int32_t cp);
+size_t edit_strwidth(const char *s, size_t len);
+
+void   edit_init(struct edit *e);
+void   edit_free(struct edit *e);
+void   edit_set(struct edit *e, const char *s, size_t len);
+void   edit_insert(struct edit *e, const char *s, size_t len);
+void   edit_delete(struct edit *e, ssize_t n, _Bool kill);
+void   edit_yank(struct edit *e);
+void   edit_move(struct edit *e, ssize_t n);
+ssize_t edit_word(struct edit *e, int dir);
+_Bool  edit_undo(struct edit *e);
+
+#endif
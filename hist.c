@@ -0,0 +1,237 @@
+/*
+ * the history of a buffer, i.e. the lines that it shows.
+ *
+ * keeping each line as a Lua table of three strings costs a table and
+ * up to three strings per line, all of which the garbage collector has
+ * to walk on every cycle; with many busy channels, that's most of the
+ * heap. instead, the text of all lines is packed into one arena, and
+ * each line is a small fixed-size record pointing into it. the time is
+ * kept as a number and only formatted when the line is drawn.
+ *
+ * lines are never removed one at a time (only all at once, by /clear),
+ * so the arena only ever grows at the end and never needs compacting.
+ *
+ * to scroll by rows rather than by lines, we need to know how many rows
+ * each line takes up once wrapped, and how many rows come before any
+ * given line. the former is kept in each record, the latter in a
+ * Fenwick tree over them, so that finding the line at a given row (or
+ * the row of a given line) takes O(log n) steps. new lines are added to
+ * the tree as they're needed, again in O(log n) steps each; only lines
+ * inserted in the middle, or a change of layout (e.g. a resize), mean
+ * rebuilding it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hist.h"
+#include "util.h"
+#include "wrap.h"
+
+/* how lines are laid out on screen. (see tui.format_line) */
+static struct {
+	size_t timew, leftw, width;
+	unsigned gen;
+} layout;
+
+#define LOWBIT(I) ((I) & -(I))
+
+void
+hist_init(struct hist *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+void
+hist_free(struct hist *h)
+{
+	free(h->arena);
+	free(h->recs);
+	free(h->rowidx);
+	hist_init(h);
+}
+
+void
+hist_clear(struct hist *h)
+{
+	h->used = 0;
+	h->len = 0;
+	h->indexed = 0;
+}
+
+static uint32_t
+store(struct hist *h, const char *s, size_t len)
+{
+	/* lines are NUL-terminated in the arena, for the convenience
+	 * of C code reading them. */
+	if (h->used + len + 1 > h->size) {
+		size_t size = h->size ? h->size : 4096;
+		while (h->used + len + 1 > size)
+			size *= 2;
+		if (size > UINT32_MAX)
+			die("history of buffer is too large");
+		if ((h->arena = realloc(h->arena, size)) == NULL)
+			die("couldn't allocate memory for history:");
+		h->size = size;
+	}
+
+	uint32_t off = h->used;
+	memcpy(&h->arena[off], s, len);
+	h->arena[off + len] = '\0';
+	h->used += len + 1;
+	return off;
+}
+
+/* make room for n lines before the line at pos (0-based), or at the
+ * end if pos is the number of lines. the new lines must then be filled
+ * in with hist_set. returns the position of the first new line. */
+size_t
+hist_open(struct hist *h, size_t pos, size_t n)
+{
+	if (pos > h->len)
+		pos = h->len;
+
+	if (h->len + n > h->cap) {
+		size_t cap = h->cap ? h->cap : 256;
+		while (h->len + n > cap)
+			cap *= 2;
+		if ((h->recs = realloc(h->recs, cap * sizeof(*h->recs))) == NULL)
+			die("couldn't allocate memory for history:");
+		if ((h->rowidx = realloc(h->rowidx, (cap + 1) * sizeof(*h->rowidx))) == NULL)
+			die("couldn't allocate memory for history:");
+		h->cap = cap;
+	}
+
+	if (pos < h->indexed)
+		h->indexed = pos;
+
+	memmove(&h->recs[pos + n], &h->recs[pos],
+		(h->len - pos) * sizeof(*h->recs));
+	h->len += n;
+	return pos;
+}
+
+void
+hist_set(struct hist *h, size_t pos, int64_t time,
+		const char *left, size_t llen, const char *right, size_t rlen,
+		uint8_t prio)
+{
+	struct hist_rec *r = &h->recs[pos];
+	r->time = time;
+	r->left = store(h, left, llen);
+	r->llen = llen;
+	r->right = store(h, right, rlen);
+	r->rlen = rlen;
+	r->prio = prio;
+}
+
+size_t
+hist_bytes(const struct hist *h)
+{
+	return h->size + h->cap * sizeof(*h->recs)
+		+ (h->cap + 1) * sizeof(*h->rowidx);
+}
+
+/* the first line at or after a time, assuming that lines are in order. */
+size_t
+hist_search(const struct hist *h, int64_t time)
+{
+	size_t lo = 0, hi = h->len;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (h->recs[mid].time < time)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* set the widths of the columns (as in tui.format_line) and the width
+ * of the screen. */
+void
+hist_layout(size_t timew, size_t leftw, size_t width)
+{
+	if (layout.gen != 0 && layout.timew == timew && layout.leftw == leftw
+			&& layout.width == width)
+		return;
+
+	layout.timew = timew;
+	layout.leftw = leftw;
+	layout.width = width;
+	++layout.gen;
+}
+
+static uint32_t
+rows(const struct hist *h, const struct hist_rec *r)
+{
+	/* until there's a layout, count each line as a row. */
+	if (layout.gen == 0)
+		return 1;
+
+	/* as in tui.format_line, a left column width of zero means
+	 * that the left column is as wide as it needs to be. */
+	size_t info = (layout.leftw ? layout.leftw : r->llen) + layout.timew;
+	size_t width = layout.width > info + 4 ? layout.width - info - 4 : 1;
+	return wrap(hist_right(h, r), r->rlen, width, NULL, NULL);
+}
+
+/* bring the Fenwick tree up to date with the lines and the layout. */
+static void
+reindex(struct hist *h)
+{
+	if (h->layout != layout.gen) {
+		h->layout = layout.gen;
+		h->indexed = 0;
+	}
+
+	for (; h->indexed < h->len; ++h->indexed) {
+		size_t i = h->indexed + 1;
+		struct hist_rec *r = &h->recs[i - 1];
+		r->rows = rows(h, r);
+
+		/* the node for i covers the lines after i - LOWBIT(i), up
+		 * to i; the nodes below it already cover all but i. */
+		uint64_t sum = r->rows;
+		for (size_t j = i - 1; j > i - LOWBIT(i); j -= LOWBIT(j))
+			sum += h->rowidx[j];
+		h->rowidx[i] = sum;
+	}
+}
+
+/* the rows taken up by the first n lines. */
+size_t
+hist_rows(struct hist *h, size_t n)
+{
+	reindex(h);
+	if (n > h->len) n = h->len;
+
+	uint64_t sum = 0;
+	for (size_t i = n; i > 0; i -= LOWBIT(i))
+		sum += h->rowidx[i];
+	return sum;
+}
+
+/* the line (0-based) on which a row (0-based, counting from the top)
+ * is, and which of that line's rows it is. if the row is past the last
+ * line, the number of lines is returned. */
+size_t
+hist_find(struct hist *h, size_t row, size_t *off)
+{
+	reindex(h);
+
+	size_t step = 1;
+	while (step * 2 <= h->len) step *= 2;
+
+	size_t pos = 0;
+	uint64_t left = row;
+	for (; step > 0; step /= 2) {
+		if (pos + step <= h->len && h->rowidx[pos + step] <= left) {
+			pos += step;
+			left -= h->rowidx[pos];
+		}
+	}
+
+	if (off) *off = left;
+	return pos;
+}
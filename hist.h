@@ -0,0 +1,53 @@
+#ifndef HIST_H
+#define HIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct hist_rec {
+	int64_t  time;          /* epoch seconds, shifted to the display timezone */
+	uint32_t left, llen;    /* offset and length of the left column in the arena */
+	uint32_t right, rlen;   /* same, for the right column */
+	uint32_t rows;          /* rows taken up on screen (see reindex in hist.c) */
+	uint8_t  prio;
+};
+
+struct hist {
+	char   *arena;          /* the text of every line, back to back */
+	size_t  used, size;
+
+	struct hist_rec *recs;  /* one per line, oldest first */
+	size_t  len, cap;
+
+	uint64_t *rowidx;       /* Fenwick tree of the lines' rows (1-based) */
+	size_t  indexed;        /* lines that are in it */
+	unsigned layout;        /* layout that it was built for */
+};
+
+void   hist_init(struct hist *h);
+void   hist_free(struct hist *h);
+void   hist_clear(struct hist *h);
+size_t hist_open(struct hist *h, size_t pos, size_t n);
+void   hist_set(struct hist *h, size_t pos, int64_t time,
+		const char *left, size_t llen, const char *right, size_t rlen,
+		uint8_t prio);
+size_t hist_bytes(const struct hist *h);
+size_t hist_search(const struct hist *h, int64_t time);
+
+void   hist_layout(size_t timew, size_t leftw, size_t width);
+size_t hist_rows(struct hist *h, size_t n);
+size_t hist_find(struct hist *h, size_t row, size_t *off);
+
+static inline const char *
+hist_left(const struct hist *h, const struct hist_rec *r)
+{
+	return &h->arena[r->left];
+}
+
+static inline const char *
+hist_right(const struct hist *h, const struct hist_rec *r)
+{
+	return &h->arena[r->right];
+}
+
+#endif
@@ -0,0 +1,423 @@
+/*
+ * sidecar indexes for the logs written by rt/logs.lua.
+ *
+ * the logs themselves stay as plain, append-only files of raw IRC
+ * messages (so that litterbox and friends can still read them). next
+ * to each <dest>.txt we keep a <dest>.idx, which splits the log into
+ * blocks of about LOGIDX_BLKSZ bytes, and stores, for each block, its
+ * offset in the log, the server-time of its first line, and a bitmap
+ * of the (case-folded) trigrams that occur in it.
+ *
+ * to search for some text, we only have to look at the blocks that
+ * contain every trigram in that text, and can skip the blocks that
+ * are older than the time we're interested in. the index is brought
+ * up to date before each search, so it only ever has to process the
+ * lines that were appended since the last search.
+ *
+ * logidx_tail() doesn't need the index at all: it maps the log and
+ * walks backwards from the end, so getting the last few lines of a
+ * log is just as cheap for a huge log as it is for a small one.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "logidx.h"
+#include "srvtime.h"
+
+#define LOGIDX_MAGIC     "LIX1"
+#define LOGIDX_BLKSZ     (32 * 1024)
+#define LOGIDX_BITS_LOG2 14
+#define LOGIDX_BITS      (1 << LOGIDX_BITS_LOG2)
+#define LOGIDX_MAXNEEDLE 512
+
+struct logidx_hdr {
+	char     magic[4];
+	uint32_t blksz;
+	uint64_t indexed;   /* number of bytes of the log that are indexed */
+	uint64_t nblocks;
+};
+
+struct logidx_blk {
+	uint64_t off;       /* offset of the block's first line */
+	int64_t  time;      /* server-time of that line, or 0 */
+	uint8_t  bloom[LOGIDX_BITS / 8];
+};
+
+#define BLKPOS(N) \
+	((off_t) (sizeof(struct logidx_hdr) + (N) * sizeof(struct logidx_blk)))
+
+#define BIT_SET(BM, N)   ((BM)[(N) / 8] |= 1 << ((N) % 8))
+#define BIT_ISSET(BM, N) ((BM)[(N) / 8] &  1 << ((N) % 8))
+
+static inline uint32_t
+trigram(const char *s)
+{
+	uint32_t t = (uint32_t) tolower(s[0]) << 16
+		| (uint32_t) tolower(s[1]) << 8 | (uint32_t) tolower(s[2]);
+	return (t * 2654435761u) >> (32 - LOGIDX_BITS_LOG2);
+}
+
+static void
+bloom_add(uint8_t *bloom, const char *line, size_t len)
+{
+	for (size_t i = 0; i + 3 <= len; ++i)
+		BIT_SET(bloom, trigram(&line[i]));
+}
+
+/* like memmem(3), but case-insensitive. needle must be lowercase. */
+static const char *
+memcasemem(const char *hay, size_t hlen, const char *needle, size_t nlen)
+{
+	if (nlen == 0)
+		return hay;
+
+	for (size_t i = 0; i + nlen <= hlen; ++i) {
+		if (tolower(hay[i]) != needle[0])
+			continue;
+
+		size_t j = 1;
+		while (j < nlen && tolower(hay[i + j]) == needle[j])
+			++j;
+		if (j == nlen)
+			return &hay[i];
+	}
+
+	return NULL;
+}
+
+/* foo/#channel.txt => foo/#channel.idx */
+static _Bool
+idxpath(char *buf, size_t sz, const char *path)
+{
+	size_t len = strlen(path);
+	if (len > 4 && !strcmp(&path[len - 4], ".txt"))
+		len -= 4;
+	return snprintf(buf, sz, "%.*s.idx", (int) len, path) < (int) sz;
+}
+
+/*
+ * get the server-time of a logged line, in seconds since the epoch.
+ * returns 0 if the line has no (valid) time tag.
+ */
+int64_t
+logidx_line_time(const char *line, size_t len)
+{
+	if (len == 0 || line[0] != '@')
+		return 0;
+
+	const char *end = memchr(line, ' ', len);
+	if (!end)
+		return 0;
+
+	const char *p = line;
+	while ((p = memmem(p, end - p, "time=", 5))) {
+		if (p[-1] == '@' || p[-1] == ';')
+			break;
+		p += 5;
+	}
+
+	if (!p)
+		return 0;
+
+	p += 5;
+	const char *tagend = memchr(p, ';', end - p);
+	int64_t ms = srvtime_parse(p, (tagend ? tagend : end) - p);
+	return ms < 0 ? 0 : ms / 1000;
+}
+
+/*
+ * bring the index of a log up to date, (re)creating it if it doesn't
+ * exist or doesn't match the log anymore.
+ */
+int
+logidx_update(const char *path)
+{
+	char ipath[PATH_MAX];
+	if (!idxpath(ipath, sizeof(ipath), path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	int ret = -1, logfd = -1, idxfd = -1, err = 0;
+	char *map = MAP_FAILED;
+	size_t size = 0;
+	struct stat st;
+
+	if ((logfd = open(path, O_RDONLY)) < 0)
+		goto done;
+	if (fstat(logfd, &st) < 0)
+		goto done;
+	if ((idxfd = open(ipath, O_RDWR | O_CREAT, 0644)) < 0)
+		goto done;
+
+	size = (size_t) st.st_size;
+
+	struct logidx_hdr hdr;
+	if (pread(idxfd, &hdr, sizeof(hdr), 0) != (ssize_t) sizeof(hdr)
+			|| memcmp(hdr.magic, LOGIDX_MAGIC, 4) != 0
+			|| hdr.blksz != LOGIDX_BLKSZ || hdr.indexed > size) {
+		/* missing, stale, or corrupt index; start over. */
+		if (ftruncate(idxfd, 0) < 0)
+			goto done;
+		memcpy(hdr.magic, LOGIDX_MAGIC, 4);
+		hdr.blksz = LOGIDX_BLKSZ, hdr.indexed = 0, hdr.nblocks = 0;
+	}
+
+	if (hdr.indexed == size) {
+		ret = 0;
+		goto done;
+	}
+
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, logfd, 0);
+	if (map == MAP_FAILED)
+		goto done;
+
+	/*
+	 * nblk: number of blocks that are already full.
+	 * blk: the block that's currently being filled, if open_blk is set.
+	 */
+	struct logidx_blk blk;
+	uint64_t nblk = hdr.nblocks;
+	_Bool open_blk = false;
+
+	/* keep filling the last block if it isn't full yet. */
+	if (nblk > 0) {
+		if (pread(idxfd, &blk, sizeof(blk), BLKPOS(nblk - 1))
+				!= (ssize_t) sizeof(blk))
+			goto done;
+		if (hdr.indexed - blk.off < LOGIDX_BLKSZ)
+			open_blk = true, --nblk;
+	}
+
+	/* don't index the last line if it hasn't been completely written. */
+	uint64_t pos = hdr.indexed;
+	const char *eol = NULL;
+	while (pos < size && (eol = memchr(&map[pos], '\n', size - pos))) {
+		size_t len = eol - &map[pos];
+
+		if (!open_blk) {
+			memset(&blk, 0x0, sizeof(blk));
+			blk.off  = pos;
+			blk.time = logidx_line_time(&map[pos], len);
+			open_blk = true;
+		}
+
+		bloom_add(blk.bloom, &map[pos], len);
+		pos += len + 1;
+
+		if (pos - blk.off >= LOGIDX_BLKSZ) {
+			if (pwrite(idxfd, &blk, sizeof(blk), BLKPOS(nblk))
+					!= (ssize_t) sizeof(blk))
+				goto done;
+			++nblk, open_blk = false;
+		}
+	}
+
+	if (open_blk) {
+		if (pwrite(idxfd, &blk, sizeof(blk), BLKPOS(nblk))
+				!= (ssize_t) sizeof(blk))
+			goto done;
+		++nblk;
+	}
+
+	hdr.indexed = pos, hdr.nblocks = nblk;
+	if (pwrite(idxfd, &hdr, sizeof(hdr), 0) != (ssize_t) sizeof(hdr))
+		goto done;
+
+	ret = 0;
+
+done:
+	err = errno;
+	if (map != MAP_FAILED) munmap(map, size);
+	if (logfd >= 0) close(logfd);
+	if (idxfd >= 0) close(idxfd);
+	errno = err;
+	return ret;
+}
+
+/*
+ * search a log for lines that contain needle (case-insensitively) and
+ * that were sent after since (if since isn't 0), calling fn for each
+ * matching line.
+ *
+ * returns the number of matching lines, or -1 on error.
+ */
+ssize_t
+logidx_search(const char *path, const char *needle, int64_t since,
+		logidx_fn fn, void *ctx)
+{
+	char ipath[PATH_MAX], lneedle[LOGIDX_MAXNEEDLE];
+	size_t nlen = strlen(needle);
+
+	if (nlen >= sizeof(lneedle)) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (size_t i = 0; i <= nlen; ++i)
+		lneedle[i] = tolower(needle[i]);
+
+	if (!idxpath(ipath, sizeof(ipath), path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	if (logidx_update(path) < 0)
+		return -1;
+
+	ssize_t hits = -1;
+	int logfd = -1, idxfd = -1, err = 0;
+	char *map = MAP_FAILED, *imap = MAP_FAILED;
+	size_t size = 0, isize = 0;
+	struct stat st;
+
+	if ((logfd = open(path, O_RDONLY)) < 0 || fstat(logfd, &st) < 0)
+		goto done;
+	if ((size = (size_t) st.st_size) == 0) {
+		hits = 0;
+		goto done;
+	}
+	if ((idxfd = open(ipath, O_RDONLY)) < 0 || fstat(idxfd, &st) < 0)
+		goto done;
+	if ((isize = (size_t) st.st_size) < sizeof(struct logidx_hdr)) {
+		errno = EINVAL;
+		goto done;
+	}
+
+	map  = mmap(NULL,  size, PROT_READ, MAP_PRIVATE, logfd, 0);
+	imap = mmap(NULL, isize, PROT_READ, MAP_PRIVATE, idxfd, 0);
+	if (map == MAP_FAILED || imap == MAP_FAILED)
+		goto done;
+
+	const struct logidx_hdr *hdr  = (const void *) imap;
+	const struct logidx_blk *blks = (const void *) &imap[sizeof(*hdr)];
+	if (isize < (size_t) BLKPOS(hdr->nblocks) || hdr->indexed > size) {
+		errno = EINVAL;
+		goto done;
+	}
+
+	/* trigrams that must all be present in a block for it to match. */
+	uint32_t tri[LOGIDX_MAXNEEDLE];
+	size_t ntri = 0;
+	for (size_t i = 0; i + 3 <= nlen; ++i)
+		tri[ntri++] = trigram(&lneedle[i]);
+
+	hits = 0;
+	for (size_t b = 0; b < hdr->nblocks; ++b) {
+		const struct logidx_blk *next = b + 1 < hdr->nblocks
+			? &blks[b + 1] : NULL;
+		uint64_t end = next ? next->off : hdr->indexed;
+
+		/* everything in this block was sent before since. */
+		if (since && next && next->time && next->time < since)
+			continue;
+
+		size_t t = 0;
+		while (t < ntri && BIT_ISSET(blks[b].bloom, tri[t]))
+			++t;
+		if (t < ntri)
+			continue;
+
+		/* since falls in this block, so check each line's time. */
+		_Bool check_time = since && blks[b].time < since;
+
+		for (uint64_t pos = blks[b].off; pos < end;) {
+			const char *line = &map[pos];
+			const char *eol  = memchr(line, '\n', end - pos);
+			size_t len = eol ? (size_t) (eol - line) : end - pos;
+			pos += len + 1;
+
+			if (!memcasemem(line, len, lneedle, nlen))
+				continue;
+			if (check_time && logidx_line_time(line, len) < since)
+				continue;
+
+			++hits;
+			if (!fn(line, len, ctx))
+				goto done;
+		}
+	}
+
+done:
+	err = errno;
+	if (map  != MAP_FAILED) munmap(map,   size);
+	if (imap != MAP_FAILED) munmap(imap, isize);
+	if (logfd >= 0) close(logfd);
+	if (idxfd >= 0) close(idxfd);
+	errno = err;
+	return hits;
+}
+
+/*
+ * call fn with each of the last n lines in the first limit bytes of a
+ * log (or in the whole log, if limit is 0), oldest first.
+ *
+ * returns the number of lines found, or -1 on error.
+ */
+ssize_t
+logidx_tail(const char *path, size_t n, size_t limit, logidx_fn fn, void *ctx)
+{
+	ssize_t found = -1;
+	int fd = -1, err = 0;
+	char *map = MAP_FAILED;
+	size_t size = 0, *starts = NULL;
+	struct stat st;
+
+	if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0)
+		goto done;
+
+	size = (size_t) st.st_size;
+	if (limit == 0 || limit > size)
+		limit = size;
+	if (limit == 0 || n == 0) {
+		found = 0;
+		goto done;
+	}
+
+	if (!(starts = calloc(n, sizeof(size_t))))
+		goto done;
+	if ((map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+		goto done;
+
+	/*
+	 * ignore the trailing newline, then look for the newlines
+	 * before each of the last n lines.
+	 */
+	size_t end = limit, i = n;
+	if (map[end - 1] == '\n')
+		--end;
+	while (i > 0 && end > 0) {
+		const char *nl = memrchr(map, '\n', end);
+		starts[--i] = nl ? (size_t) (nl - map) + 1 : 0;
+		end = nl ? (size_t) (nl - map) : 0;
+	}
+
+	found = 0;
+	for (; i < n; ++i) {
+		const char *line = &map[starts[i]];
+		const char *eol  = memchr(line, '\n', limit - starts[i]);
+		size_t len = eol ? (size_t) (eol - line) : limit - starts[i];
+
+		++found;
+		if (!fn(line, len, ctx))
+			break;
+	}
+
+done:
+	err = errno;
+	free(starts);
+	if (map != MAP_FAILED) munmap(map, size);
+	if (fd >= 0) close(fd);
+	errno = err;
+	return found;
+}
@@ -0,0 +1,18 @@
+#ifndef LOGIDX_H
+#define LOGIDX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* called for each matching line. return false to stop searching. */
+typedef _Bool (*logidx_fn)(const char *line, size_t len, void *ctx);
+
+int     logidx_update(const char *path);
+ssize_t logidx_search(const char *path, const char *needle, int64_t since,
+		logidx_fn fn, void *ctx);
+ssize_t logidx_tail(const char *path, size_t n, size_t limit,
+		logidx_fn fn, void *ctx);
+int64_t logidx_line_time(const char *line, size_t len);
+
+#endif
@@ -1,6 +1,9 @@
 #include <assert.h>
 #include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <lauxlib.h>
 #include <lua.h>
 #include <lualib.h>
@@ -14,13 +17,21 @@
 #include <tls.h>
 #include <unistd.h>
 
+#include "alloc.h"
 #include "dwidth.h"
+#include "edit.h"
+#include "hist.h"
+#include "logidx.h"
 #include "luaa.h"
 #include "luau.h"
 #include "mirc.h"
+#include "nickcol.h"
+#include "proc.h"
+#include "srvtime.h"
 #include "termbox.h"
 #include "util.h"
 #include "utf8proc.h"
+#include "wrap.h"
 
 extern int conn_fd;
 extern lua_State *L;
@@ -36,6 +47,7 @@ const static struct luaL_Reg lurch_conn_lib[] = {
 	{ "init",       api_conn_init   },
 	{ "send",       api_conn_send   },
 	{ "is_active",  api_conn_active },
+	{ "resumed",    api_conn_resumed },
 	{ "close",      api_conn_close  },
 	{ NULL, NULL },
 };
@@ -52,6 +64,84 @@ const static struct luaL_Reg lurch_termbox_lib[] = {
 const static struct luaL_Reg lurch_utf8_lib[] = {
 	{ "insert",   api_utf8_insert },
 	{ "dwidth",   api_utf8_dwidth },
+	{ "window",   api_utf8_window },
+	{ NULL, NULL },
+};
+
+const static struct luaL_Reg lurch_log_lib[] = {
+	{ "list",     api_log_list   },
+	{ "search",   api_log_search },
+	{ "size",     api_log_size   },
+	{ "tail",     api_log_tail   },
+	{ NULL, NULL },
+};
+
+const static struct luaL_Reg lurch_edit_lib[] = {
+	{ "new",      api_edit_new   },
+	{ NULL, NULL },
+};
+
+const static struct luaL_Reg lurch_edit_methods[] = {
+	{ "insert",   api_edit_insert },
+	{ "delete",   api_edit_delete },
+	{ "kill",     api_edit_kill   },
+	{ "yank",     api_edit_yank   },
+	{ "move",     api_edit_move   },
+	{ "word",     api_edit_word   },
+	{ "undo",     api_edit_undo   },
+	{ "set",      api_edit_set    },
+	{ "text",     api_edit_text   },
+	{ "cursor",   api_edit_cursor },
+	{ "len",      api_edit_len    },
+	{ "column",   api_edit_column },
+	{ NULL, NULL },
+};
+
+const static struct luaL_Reg lurch_hist_lib[] = {
+	{ "new",      api_hist_new    },
+	{ "layout",   api_hist_layout },
+	{ "fold",     api_hist_fold   },
+	{ NULL, NULL },
+};
+
+const static struct luaL_Reg lurch_hist_methods[] = {
+	{ "push",     api_hist_push   },
+	{ "insert",   api_hist_insert },
+	{ "clear",    api_hist_clear  },
+	{ "get",      api_hist_get    },
+	{ "bytes",    api_hist_bytes  },
+	{ "rows",     api_hist_rows   },
+	{ "locate",   api_hist_locate },
+	{ "search",   api_hist_search },
+	{ NULL, NULL },
+};
+
+const static struct luaL_Reg lurch_time_lib[] = {
+	{ "parse",    api_time_parse  },
+	{ "now",      api_time_now    },
+	{ "at",       api_time_at     },
+	{ "format",   api_time_format },
+	{ "iso",      api_time_iso    },
+	{ NULL, NULL },
+};
+
+const static struct luaL_Reg lurch_color_lib[] = {
+	{ "palette",  api_color_palette },
+	{ "color",    api_color_color   },
+	{ "prefix",   api_color_prefix  },
+	{ NULL, NULL },
+};
+
+const static struct luaL_Reg lurch_proc_lib[] = {
+	{ "spawn",    api_proc_spawn   },
+	{ "kill",     api_proc_kill    },
+	{ "running",  api_proc_running },
+	{ NULL, NULL },
+};
+
+const static struct luaL_Reg lurch_mem_lib[] = {
+	{ "phase",    api_mem_phase  },
+	{ "stats",    api_mem_stats  },
 	{ NULL, NULL },
 };
 
@@ -67,11 +157,80 @@ llua_openlib(lua_State *pL)
 		llua_setfuncs(pL, lurch_conn_lib);
 	} else if (!strcmp(lib, "utf8utils")) {
 		llua_setfuncs(pL, lurch_utf8_lib);
+	} else if (!strcmp(lib, "lurchlog")) {
+		llua_setfuncs(pL, lurch_log_lib);
+	} else if (!strcmp(lib, "lurchmem")) {
+		llua_setfuncs(pL, lurch_mem_lib);
+	} else if (!strcmp(lib, "lurchcolor")) {
+		llua_setfuncs(pL, lurch_color_lib);
+	} else if (!strcmp(lib, "lurchproc")) {
+		llua_setfuncs(pL, lurch_proc_lib);
+	} else if (!strcmp(lib, "lurchtime")) {
+		llua_setfuncs(pL, lurch_time_lib);
+	} else if (!strcmp(lib, "lurchedit")) {
+		llua_setfuncs(pL, lurch_edit_lib);
+
+		/* __gc is kept out of the methods, so that it can't be
+		 * called from Lua while the editor is still in use. */
+		luaL_newmetatable(pL, "lurchedit");
+		lua_newtable(pL);
+		llua_setfuncs(pL, lurch_edit_methods);
+		lua_setfield(pL, -2, "__index");
+		lua_pushcfunction(pL, api_edit_gc);
+		lua_setfield(pL, -2, "__gc");
+		lua_pop(pL, 1);
+	} else if (!strcmp(lib, "lurchhist")) {
+		llua_setfuncs(pL, lurch_hist_lib);
+
+		/* histories are indexed both by line number and by method
+		 * name, so __index is a function that has the methods at
+		 * hand. */
+		luaL_newmetatable(pL, "lurchhist");
+		lua_newtable(pL);
+		llua_setfuncs(pL, lurch_hist_methods);
+		lua_pushcclosure(pL, api_hist_index, 1);
+		lua_setfield(pL, -2, "__index");
+		lua_pushcfunction(pL, api_hist_len);
+		lua_setfield(pL, -2, "__len");
+		lua_pushcfunction(pL, api_hist_gc);
+		lua_setfield(pL, -2, "__gc");
+		lua_pop(pL, 1);
 	}
 
 	return 1;
 }
 
+/*
+ * the address that was last connected to successfully, which is tried
+ * first when reconnecting to the same host, skipping the resolver.
+ */
+static struct {
+	char host[256], port[32];
+	struct sockaddr_storage addr;
+	socklen_t len;
+	int family;
+} lastaddr;
+
+/*
+ * the TLS config is kept across connections, along with a file for
+ * libtls to store the session in, so that reconnects can resume the
+ * previous session instead of doing a full handshake.
+ */
+static struct tls_config *tlscfg = NULL;
+static FILE *tlssess = NULL;
+
+static int
+conn_try(int family, const struct sockaddr *addr, socklen_t len)
+{
+	int fd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+	if (fd == -1) return -1;
+	if (connect(fd, addr, len) == 0) return fd;
+	int e = errno;
+	close(fd);
+	errno = e;
+	return -1;
+}
+
 int
 api_conn_init(lua_State *pL)
 {
@@ -79,44 +238,78 @@ api_conn_init(lua_State *pL)
 	char *port = (char *) luaL_checkstring(pL, 2);
 	_Bool  tls = lua_toboolean(pL, 3);
 
-	struct addrinfo hints = {
-		.ai_protocol = IPPROTO_TCP,
-		.ai_socktype = SOCK_STREAM,
-		.ai_family = AF_UNSPEC,
-	};
-	struct addrinfo *res, *r;
-
-	if(getaddrinfo(host, port, &hints, &res) != 0) {
-		LLUA_ERR(pL, format("can't resolve: %s", strerror(errno)));
+	/* drop whatever is left of the previous connection. */
+	if (client) {
+		tls_free(client);
+		client = NULL;
 	}
+	if (conn_fd > 0) close(conn_fd);
+	conn_fd = -1;
 
-	for(r = res; r != NULL; r = r->ai_next) {
-		if((conn_fd = socket(r->ai_family, r->ai_socktype, r->ai_protocol)) == -1)
-			continue;
-		if(connect(conn_fd, r->ai_addr, r->ai_addrlen) == 0)
-			break;
-		close(conn_fd);
+	if (lastaddr.len > 0 && !strcmp(lastaddr.host, host)
+			&& !strcmp(lastaddr.port, port)) {
+		conn_fd = conn_try(lastaddr.family,
+			(struct sockaddr *) &lastaddr.addr, lastaddr.len);
 	}
 
-	freeaddrinfo(res);
+	if (conn_fd == -1) {
+		struct addrinfo hints = {
+			.ai_protocol = IPPROTO_TCP,
+			.ai_socktype = SOCK_STREAM,
+			.ai_family = AF_UNSPEC,
+		};
+		struct addrinfo *res, *r;
+
+		if(getaddrinfo(host, port, &hints, &res) != 0) {
+			conn_fd = 0;
+			LLUA_ERR(pL, format("can't resolve: %s", strerror(errno)));
+		}
+
+		for(r = res; r != NULL; r = r->ai_next) {
+			conn_fd = conn_try(r->ai_family, r->ai_addr, r->ai_addrlen);
+			if (conn_fd != -1) break;
+		}
+
+		if (r != NULL && r->ai_addrlen <= sizeof(lastaddr.addr)) {
+			strncpy(lastaddr.host, host, sizeof(lastaddr.host) - 1);
+			strncpy(lastaddr.port, port, sizeof(lastaddr.port) - 1);
+			memcpy(&lastaddr.addr, r->ai_addr, r->ai_addrlen);
+			lastaddr.len = r->ai_addrlen;
+			lastaddr.family = r->ai_family;
+		}
+
+		freeaddrinfo(res);
+
+		if (r == NULL) {
+			conn_fd = 0;
+			LLUA_ERR(pL, format("can't connect: %s", strerror(errno)));
+		}
+	}
 
 	tls_active = tls;
 	if (tls_active) {
-		struct tls_config *tlscfg = tls_config_new();
-		if (!tlscfg) LLUA_ERR(pL, format("tls_config_new() == NULL"));
-		if (tls_config_set_ciphers(tlscfg, "compat") != 0)
-			LLUA_ERR(pL, format("tls_config: %s", tls_config_error(tlscfg)));
+		if (!tlscfg) {
+			tlscfg = tls_config_new();
+			if (!tlscfg) LLUA_ERR(pL, format("tls_config_new() == NULL"));
+			if (tls_config_set_ciphers(tlscfg, "compat") != 0) {
+				char *err = format("tls_config: %s", tls_config_error(tlscfg));
+				tls_config_free(tlscfg);
+				tlscfg = NULL;
+				LLUA_ERR(pL, err);
+			}
+
+			/* not being able to resume sessions isn't fatal. The
+			 * session is secret, so keep it from child processes. */
+			if ((tlssess = tmpfile()) != NULL) {
+				fcntl(fileno(tlssess), F_SETFD, FD_CLOEXEC);
+				tls_config_set_session_fd(tlscfg, fileno(tlssess));
+			}
+		}
+
 		client = tls_client();
 		if (!client) LLUA_ERR(pL, format("tls_client() == NULL"));
 		if (tls_configure(client, tlscfg) != 0)
 			LLUA_ERR(pL, format("tls_config: %s", tls_error(client)));
-		tls_config_free(tlscfg);
-	}
-
-	if (r == NULL)
-		LLUA_ERR(pL, format("can't connect: %s", strerror(errno)));
-
-	if (tls_active) {
 		if (tls_connect_socket(client, conn_fd, host) != 0)
 			LLUA_ERR(pL, format("tls: can't connect: %s", tls_error(client)));
 		if (tls_handshake(client) != 0)
@@ -127,6 +320,14 @@ api_conn_init(lua_State *pL)
 	return 1;
 }
 
+int
+api_conn_resumed(lua_State *pL)
+{
+	lua_pushboolean(pL, tls_active && client
+		&& tls_conn_session_resumed(client) == 1);
+	return 1;
+}
+
 int
 api_conn_active(lua_State *pL)
 {
@@ -175,7 +376,11 @@ api_conn_close(lua_State *pL)
 	if (tls_active && client) {
 		tls_close(client);
 		tls_free(client);
-	} else if (conn_fd != 0) {
+		client = NULL;
+	}
+
+	/* libtls doesn't close sockets it was given. */
+	if (conn_fd != 0) {
 		close(conn_fd);
 		conn_fd = 0;
 	}
@@ -396,3 +601,753 @@ api_utf8_dwidth(lua_State *pL)
 	lua_pushinteger(pL, (lua_Integer) accm);
 	return 1;
 }
+
+/*
+ * get the part of a string that fits in a given number of columns and
+ * keeps the given cursor column in view, along with the cursor's column
+ * in that part.
+ */
+int
+api_utf8_window(lua_State *pL)
+{
+	size_t len = 0;
+	const char *str = luaL_checklstring(pL, 1, &len);
+	size_t col   = (size_t) luaL_checkinteger(pL, 2);
+	size_t width = (size_t) luaL_checkinteger(pL, 3);
+
+	/* scroll far enough that the cursor fits after the last column. */
+	size_t skip = col >= width ? col - width + 1 : 0;
+	size_t start = 0, skipped = 0, end = 0, shown = 0;
+	utf8proc_int32_t cp = 0;
+
+	while (start < len && skipped < skip) {
+		ssize_t chsz = utf8proc_iterate((const utf8proc_uint8_t *) &str[start],
+			(utf8proc_ssize_t) (len - start), &cp);
+		if (chsz < 0) { chsz = 1; cp = 0xFFFD; }
+		skipped += edit_cpwidth(cp);
+		start += (size_t) chsz;
+	}
+
+	for (end = start; end < len;) {
+		ssize_t chsz = utf8proc_iterate((const utf8proc_uint8_t *) &str[end],
+			(utf8proc_ssize_t) (len - end), &cp);
+		if (chsz < 0) { chsz = 1; cp = 0xFFFD; }
+		if (shown + edit_cpwidth(cp) > width)
+			break;
+		shown += edit_cpwidth(cp);
+		end += (size_t) chsz;
+	}
+
+	lua_pushlstring(pL, &str[start], end - start);
+	lua_pushinteger(pL, (lua_Integer) (col - skipped));
+	return 2;
+}
+
+/* create an input line editor. (see edit.c) */
+int
+api_edit_new(lua_State *pL)
+{
+	size_t len = 0;
+	const char *text = luaL_optlstring(pL, 1, "", &len);
+
+	struct edit *e = lua_newuserdata(pL, sizeof(struct edit));
+	edit_init(e);
+	edit_set(e, text, len);
+
+	luaL_setmetatable(pL, "lurchedit");
+	return 1;
+}
+
+int
+api_edit_insert(lua_State *pL)
+{
+	struct edit *e = luaL_checkudata(pL, 1, "lurchedit");
+	size_t len = 0;
+	const char *text = luaL_checklstring(pL, 2, &len);
+	edit_insert(e, text, len);
+	return 0;
+}
+
+int
+api_edit_delete(lua_State *pL)
+{
+	struct edit *e = luaL_checkudata(pL, 1, "lurchedit");
+	edit_delete(e, (ssize_t) luaL_checkinteger(pL, 2), false);
+	return 0;
+}
+
+int
+api_edit_kill(lua_State *pL)
+{
+	struct edit *e = luaL_checkudata(pL, 1, "lurchedit");
+	edit_delete(e, (ssize_t) luaL_checkinteger(pL, 2), true);
+	return 0;
+}
+
+int
+api_edit_yank(lua_State *pL)
+{
+	struct edit *e = luaL_checkudata(pL, 1, "lurchedit");
+	edit_yank(e);
+	return 0;
+}
+
+int
+api_edit_move(lua_State *pL)
+{
+	struct edit *e = luaL_checkudata(pL, 1, "lurchedit");
+	edit_move(e, (ssize_t) luaL_checkinteger(pL, 2));
+	return 0;
+}
+
+int
+api_edit_word(lua_State *pL)
+{
+	struct edit *e = luaL_checkudata(pL, 1, "lurchedit");
+	lua_pushinteger(pL, (lua_Integer) edit_word(e, (int) luaL_checkinteger(pL, 2)));
+	return 1;
+}
+
+int
+api_edit_undo(lua_State *pL)
+{
+	struct edit *e = luaL_checkudata(pL, 1, "lurchedit");
+	lua_pushboolean(pL, edit_undo(e));
+	return 1;
+}
+
+int
+api_edit_set(lua_State *pL)
+{
+	struct edit *e = luaL_checkudata(pL, 1, "lurchedit");
+	size_t len = 0;
+	const char *text = luaL_checklstring(pL, 2, &len);
+	edit_set(e, text, len);
+	return 0;
+}
+
+int
+api_edit_text(lua_State *pL)
+{
+	struct edit *e = luaL_checkudata(pL, 1, "lurchedit");
+
+	luaL_Buffer b;
+	luaL_buffinit(pL, &b);
+	luaL_addlstring(&b, e->buf, e->gap);
+	luaL_addlstring(&b, &e->buf[e->gapend], e->size - e->gapend);
+	luaL_pushresult(&b);
+	return 1;
+}
+
+int
+api_edit_cursor(lua_State *pL)
+{
+	struct edit *e = luaL_checkudata(pL, 1, "lurchedit");
+	lua_pushinteger(pL, (lua_Integer) e->cursor);
+	return 1;
+}
+
+int
+api_edit_len(lua_State *pL)
+{
+	struct edit *e = luaL_checkudata(pL, 1, "lurchedit");
+	lua_pushinteger(pL, (lua_Integer) e->len);
+	return 1;
+}
+
+int
+api_edit_column(lua_State *pL)
+{
+	struct edit *e = luaL_checkudata(pL, 1, "lurchedit");
+	lua_pushinteger(pL, (lua_Integer) e->col);
+	return 1;
+}
+
+int
+api_edit_gc(lua_State *pL)
+{
+	struct edit *e = luaL_checkudata(pL, 1, "lurchedit");
+	edit_free(e);
+	return 0;
+}
+
+/*
+ * a buffer's history. the time format is kept in the history's user
+ * value, as times are only formatted when lines are looked up.
+ */
+int
+api_hist_new(lua_State *pL)
+{
+	luaL_checkstring(pL, 1);
+
+	struct hist *h = lua_newuserdata(pL, sizeof(struct hist));
+	hist_init(h);
+	luaL_setmetatable(pL, "lurchhist");
+
+	lua_pushvalue(pL, 1);
+	lua_setuservalue(pL, -2);
+	return 1;
+}
+
+static void
+hist_setline(lua_State *pL, struct hist *h, size_t pos, int idx)
+{
+	size_t llen, rlen;
+	int64_t time = (int64_t) luaL_checkinteger(pL, idx);
+	const char *left = luaL_checklstring(pL, idx + 1, &llen);
+	const char *right = luaL_checklstring(pL, idx + 2, &rlen);
+	uint8_t prio = (uint8_t) lua_tointeger(pL, idx + 3);
+
+	hist_set(h, pos, time, left, llen, right, rlen, prio);
+}
+
+/* h:push(time, left, right, prio?) */
+int
+api_hist_push(lua_State *pL)
+{
+	struct hist *h = luaL_checkudata(pL, 1, "lurchhist");
+	size_t pos = hist_open(h, h->len, 1);
+	hist_setline(pL, h, pos, 2);
+	return 0;
+}
+
+/* h:insert(pos, lines), where each line is { time, left, right, prio? }
+ * and pos is the (1-based) line they're inserted before. */
+int
+api_hist_insert(lua_State *pL)
+{
+	struct hist *h = luaL_checkudata(pL, 1, "lurchhist");
+	lua_Integer pos = luaL_checkinteger(pL, 2);
+	luaL_checktype(pL, 3, LUA_TTABLE);
+
+	size_t n = llua_rawlen(pL, 3);
+	if (pos < 1 || (size_t) pos > h->len + 1)
+		return luaL_argerror(pL, 2, "position out of range");
+
+	/* check the lines before making room for them, so that a bad
+	 * line doesn't leave holes in the history. */
+	for (size_t i = 1; i <= n; ++i) {
+		lua_rawgeti(pL, 3, i);
+		if (!lua_istable(pL, -1))
+			return luaL_argerror(pL, 3, "lines must be tables");
+		lua_rawgeti(pL, -1, 1);
+		lua_rawgeti(pL, -2, 2);
+		lua_rawgeti(pL, -3, 3);
+		if (!lua_isinteger(pL, -3) || !lua_isstring(pL, -2)
+				|| !lua_isstring(pL, -1))
+			return luaL_argerror(pL, 3, "lines must be { time, left, right }");
+		lua_pop(pL, 4);
+	}
+
+	size_t start = hist_open(h, pos - 1, n);
+	for (size_t i = 0; i < n; ++i) {
+		lua_rawgeti(pL, 3, i + 1);
+		for (int j = 1; j <= 4; ++j)
+			lua_rawgeti(pL, -j, j);
+		hist_setline(pL, h, start + i, lua_gettop(pL) - 3);
+		lua_pop(pL, 5);
+	}
+
+	return 0;
+}
+
+int
+api_hist_clear(lua_State *pL)
+{
+	struct hist *h = luaL_checkudata(pL, 1, "lurchhist");
+	hist_clear(h);
+	return 0;
+}
+
+/* h:get(i) -> time, left, right, prio */
+int
+api_hist_get(lua_State *pL)
+{
+	struct hist *h = luaL_checkudata(pL, 1, "lurchhist");
+	lua_Integer i = luaL_checkinteger(pL, 2);
+	if (i < 1 || (size_t) i > h->len)
+		return 0;
+
+	struct hist_rec *r = &h->recs[i - 1];
+	lua_pushinteger(pL, r->time);
+	lua_pushlstring(pL, hist_left(h, r), r->llen);
+	lua_pushlstring(pL, hist_right(h, r), r->rlen);
+	lua_pushinteger(pL, r->prio);
+	return 4;
+}
+
+int
+api_hist_bytes(lua_State *pL)
+{
+	struct hist *h = luaL_checkudata(pL, 1, "lurchhist");
+	lua_pushinteger(pL, hist_bytes(h));
+	return 1;
+}
+
+/* lurchhist.layout(timew, leftw, width): see tui.format_line. */
+int
+api_hist_layout(lua_State *pL)
+{
+	lua_Integer timew = luaL_checkinteger(pL, 1);
+	lua_Integer leftw = luaL_checkinteger(pL, 2);
+	lua_Integer width = luaL_checkinteger(pL, 3);
+
+	hist_layout(timew > 0 ? timew : 0, leftw > 0 ? leftw : 0,
+		width > 0 ? width : 0);
+	return 0;
+}
+
+struct fold {
+	luaL_Buffer *b;
+	const char *s;
+	size_t last;
+};
+
+static void
+fold_break(size_t at, void *ctx)
+{
+	struct fold *f = ctx;
+	luaL_addlstring(f->b, &f->s[f->last], at - f->last);
+	luaL_addchar(f->b, '\n');
+	f->last = at;
+}
+
+/* lurchhist.fold(text, width): wrap text to width columns. */
+int
+api_hist_fold(lua_State *pL)
+{
+	size_t len = 0;
+	const char *s = luaL_checklstring(pL, 1, &len);
+	lua_Integer width = luaL_checkinteger(pL, 2);
+
+	luaL_Buffer b;
+	luaL_buffinit(pL, &b);
+	struct fold f = { &b, s, 0 };
+	wrap(s, len, width > 0 ? width : 0, fold_break, &f);
+	luaL_addlstring(&b, &s[f.last], len - f.last);
+	luaL_pushresult(&b);
+	return 1;
+}
+
+/* h:rows(n?) -> the rows taken up by the first n lines (or all of them) */
+int
+api_hist_rows(lua_State *pL)
+{
+	struct hist *h = luaL_checkudata(pL, 1, "lurchhist");
+	lua_Integer n = luaL_optinteger(pL, 2, h->len);
+
+	lua_pushinteger(pL, hist_rows(h, n > 0 ? n : 0));
+	return 1;
+}
+
+/*
+ * h:locate(scroll) -> the line shown on the bottom row when scrolled up
+ * by scroll rows, and how many of that line's rows are below the bottom
+ * row (i.e. aren't shown).
+ */
+int
+api_hist_locate(lua_State *pL)
+{
+	struct hist *h = luaL_checkudata(pL, 1, "lurchhist");
+	lua_Integer scroll = luaL_checkinteger(pL, 2);
+
+	size_t total = hist_rows(h, h->len);
+	if (scroll < 0) scroll = 0;
+	if ((size_t) scroll >= total) {
+		lua_pushinteger(pL, 0);
+		lua_pushinteger(pL, 0);
+		return 2;
+	}
+
+	size_t off = 0;
+	size_t line = hist_find(h, total - 1 - scroll, &off);
+	lua_pushinteger(pL, line + 1);
+	lua_pushinteger(pL, h->recs[line].rows - 1 - off);
+	return 2;
+}
+
+/* h:search(time) -> the first line at or after time */
+int
+api_hist_search(lua_State *pL)
+{
+	struct hist *h = luaL_checkudata(pL, 1, "lurchhist");
+	int64_t time = (int64_t) luaL_checkinteger(pL, 2);
+
+	lua_pushinteger(pL, hist_search(h, time) + 1);
+	return 1;
+}
+
+/* h[i] -> { timestr, left, right }, or h.method */
+int
+api_hist_index(lua_State *pL)
+{
+	struct hist *h = luaL_checkudata(pL, 1, "lurchhist");
+
+	if (lua_type(pL, 2) != LUA_TNUMBER) {
+		lua_gettable(pL, lua_upvalueindex(1));
+		return 1;
+	}
+
+	lua_Integer i = lua_tointeger(pL, 2);
+	if (i < 1 || (size_t) i > h->len) {
+		lua_pushnil(pL);
+		return 1;
+	}
+
+	struct hist_rec *r = &h->recs[i - 1];
+	lua_getuservalue(pL, 1);
+	const char *fmt = lua_tostring(pL, -1);
+
+	lua_createtable(pL, 3, 0);
+	lua_pushstring(pL, srvtime_format(fmt, r->time));
+	lua_rawseti(pL, -2, 1);
+	lua_pushlstring(pL, hist_left(h, r), r->llen);
+	lua_rawseti(pL, -2, 2);
+	lua_pushlstring(pL, hist_right(h, r), r->rlen);
+	lua_rawseti(pL, -2, 3);
+	return 1;
+}
+
+int
+api_hist_len(lua_State *pL)
+{
+	struct hist *h = luaL_checkudata(pL, 1, "lurchhist");
+	lua_pushinteger(pL, h->len);
+	return 1;
+}
+
+int
+api_hist_gc(lua_State *pL)
+{
+	struct hist *h = luaL_checkudata(pL, 1, "lurchhist");
+	hist_free(h);
+	return 0;
+}
+
+/* list the logs in a directory, without the .txt extension. */
+int
+api_log_list(lua_State *pL)
+{
+	char *path = (char *) luaL_checkstring(pL, 1);
+
+	DIR *dir = opendir(path);
+	if (!dir) LLUA_ERR(pL, format("%s: %s", path, strerror(errno)));
+
+	lua_settop(pL, 0);
+	lua_newtable(pL);
+
+	size_t i = 0;
+	struct dirent *ent;
+	while ((ent = readdir(dir))) {
+		size_t len = strlen(ent->d_name);
+		if (len <= 4 || strcmp(&ent->d_name[len - 4], ".txt"))
+			continue;
+
+		lua_pushinteger(pL, ++i);
+		lua_pushlstring(pL, ent->d_name, len - 4);
+		lua_settable(pL, -3);
+	}
+
+	closedir(dir);
+	return 1;
+}
+
+struct log_search_ctx {
+	lua_State *pL;
+	_Bool failed;
+};
+
+static _Bool
+log_search_hit(const char *line, size_t len, void *ctx)
+{
+	struct log_search_ctx *c = ctx;
+
+	lua_pushvalue(c->pL, 4);
+	lua_pushlstring(c->pL, line, len);
+	if (lua_pcall(c->pL, 1, 1, 0) != LUA_OK) {
+		c->failed = true;
+		return false;
+	}
+
+	/* stop if the callback returned false (but not nil). */
+	_Bool cont = lua_type(c->pL, -1) != LUA_TBOOLEAN
+		|| lua_toboolean(c->pL, -1);
+	lua_pop(c->pL, 1);
+	return cont;
+}
+
+/*
+ * search a log for text, calling a function with each matching line.
+ * (see logidx.c)
+ */
+int
+api_log_search(lua_State *pL)
+{
+	char *path = (char *) luaL_checkstring(pL, 1);
+	char *text = (char *) luaL_checkstring(pL, 2);
+	int64_t since = (int64_t) luaL_optinteger(pL, 3, 0);
+	luaL_checktype(pL, 4, LUA_TFUNCTION);
+	lua_settop(pL, 4);
+
+	struct log_search_ctx ctx = { pL, false };
+	ssize_t hits = logidx_search(path, text, since, log_search_hit, &ctx);
+
+	/* rethrow the callback's error now that the log is unmapped. */
+	if (ctx.failed)
+		return lua_error(pL);
+	if (hits < 0)
+		LLUA_ERR(pL, format("%s: %s", path, strerror(errno)));
+
+	lua_pushinteger(pL, (lua_Integer) hits);
+	return 1;
+}
+
+/* get the size of a log, or nil if it doesn't exist. */
+int
+api_log_size(lua_State *pL)
+{
+	char *path = (char *) luaL_checkstring(pL, 1);
+
+	struct stat st;
+	if (stat(path, &st) < 0)
+		LLUA_ERR(pL, format("%s: %s", path, strerror(errno)));
+
+	lua_pushinteger(pL, (lua_Integer) st.st_size);
+	return 1;
+}
+
+static _Bool
+log_tail_line(const char *line, size_t len, void *ctx)
+{
+	lua_State *pL = ctx;
+	lua_pushinteger(pL, llua_rawlen(pL, -1) + 1);
+	lua_pushlstring(pL, line, len);
+	lua_settable(pL, -3);
+	return true;
+}
+
+/*
+ * get the last n lines of a log as a table, optionally only looking
+ * at the first <limit> bytes of the log.
+ */
+int
+api_log_tail(lua_State *pL)
+{
+	char *path = (char *) luaL_checkstring(pL, 1);
+	size_t n = (size_t) luaL_checkinteger(pL, 2);
+	size_t limit = (size_t) luaL_optinteger(pL, 3, 0);
+
+	lua_settop(pL, 0);
+	lua_newtable(pL);
+
+	if (logidx_tail(path, n, limit, log_tail_line, pL) < 0)
+		LLUA_ERR(pL, format("%s: %s", path, strerror(errno)));
+
+	return 1;
+}
+
+/* set the colours that names are highlighted with. (see nickcol.c) */
+int
+api_color_palette(lua_State *pL)
+{
+	luaL_checktype(pL, 1, LUA_TTABLE);
+
+	size_t len = llua_rawlen(pL, 1);
+	int colors[len + 1];
+	for (size_t i = 0; i < len; ++i) {
+		lua_rawgeti(pL, 1, (lua_Integer) i + 1);
+		colors[i] = (int) lua_tointeger(pL, -1);
+		lua_pop(pL, 1);
+	}
+
+	nickcol_palette(colors, len);
+	return 0;
+}
+
+int
+api_color_color(lua_State *pL)
+{
+	size_t len = 0;
+	const char *key = luaL_checklstring(pL, 1, &len);
+
+	int color = nickcol_color(key, len);
+	if (color < 0)
+		lua_pushnil(pL);
+	else
+		lua_pushinteger(pL, (lua_Integer) color);
+	return 1;
+}
+
+int
+api_color_prefix(lua_State *pL)
+{
+	size_t len = 0;
+	const char *key = luaL_checklstring(pL, 1, &len);
+	_Bool bold = lua_toboolean(pL, 2);
+
+	lua_pushstring(pL, nickcol_prefix(key, len, bold));
+	return 1;
+}
+
+/* parse a server-time tag into milliseconds since the epoch. */
+int
+api_time_parse(lua_State *pL)
+{
+	size_t len = 0;
+	const char *str = luaL_checklstring(pL, 1, &len);
+
+	int64_t ms = srvtime_parse(str, len);
+	if (ms < 0) LLUA_ERR(pL, format("invalid time: %s", str));
+
+	lua_pushinteger(pL, (lua_Integer) ms);
+	return 1;
+}
+
+int
+api_time_now(lua_State *pL)
+{
+	lua_pushinteger(pL, (lua_Integer) srvtime_now());
+	return 1;
+}
+
+/*
+ * get the time given by a server-time tag (or the current time, if
+ * there's no tag or it's invalid) in a timezone, as a shifted epoch
+ * that can be passed to api_time_format. (see srvtime.c)
+ */
+int
+api_time_at(lua_State *pL)
+{
+	const char *tz = luaL_checkstring(pL, 1);
+	size_t len = 0;
+	const char *tag = luaL_optlstring(pL, 2, NULL, &len);
+
+	int64_t offset = 0;
+	if (!srvtime_offset(tz, &offset))
+		LLUA_ERR(pL, format("invalid timezone: %s", tz));
+
+	int64_t ms = tag ? srvtime_parse(tag, len) : -1;
+	if (ms < 0) ms = srvtime_now();
+
+	lua_pushinteger(pL, (lua_Integer) (ms / 1000 + offset));
+	return 1;
+}
+
+int
+api_time_format(lua_State *pL)
+{
+	const char *fmt = luaL_checkstring(pL, 1);
+	int64_t secs = (int64_t) luaL_checkinteger(pL, 2);
+
+	lua_pushstring(pL, srvtime_format(fmt, secs));
+	return 1;
+}
+
+/* format a time (or the current time) as a server-time tag. */
+int
+api_time_iso(lua_State *pL)
+{
+	int64_t ms = (int64_t) luaL_optinteger(pL, 1, srvtime_now());
+
+	char buf[32];
+	srvtime_iso(ms, buf, sizeof(buf));
+	lua_pushstring(pL, buf);
+	return 1;
+}
+
+/*
+ * set the phase that new allocations are counted under, and return the
+ * previous one. (see alloc.c)
+ */
+int
+api_mem_phase(lua_State *pL)
+{
+	const char *name = luaL_checkstring(pL, 1);
+
+	size_t i = 0;
+	for (; i < ALLOC_NPHASES; ++i)
+		if (!strcmp(name, alloc_phase_names[i]))
+			break;
+	if (i == ALLOC_NPHASES)
+		return luaL_argerror(pL, 1, "unknown phase");
+
+	enum alloc_phase old = alloc_setphase((enum alloc_phase) i);
+	lua_pushstring(pL, alloc_phase_names[old]);
+	return 1;
+}
+
+int
+api_mem_stats(lua_State *pL)
+{
+	struct alloc_stats stats;
+	alloc_getstats(&stats);
+
+	lua_settop(pL, 0);
+	lua_newtable(pL);
+
+	lua_pushstring(pL, "live");
+	lua_newtable(pL);
+	for (size_t i = 0; i < ALLOC_NPHASES; ++i)
+		SETTABLE_INT(pL, alloc_phase_names[i], stats.live[i], -3);
+	lua_settable(pL, -3);
+
+	lua_pushstring(pL, "count");
+	lua_newtable(pL);
+	for (size_t i = 0; i < ALLOC_NPHASES; ++i)
+		SETTABLE_INT(pL, alloc_phase_names[i], stats.count[i], -3);
+	lua_settable(pL, -3);
+
+	SETTABLE_INT(pL, "pooled", stats.pooled, -3);
+	SETTABLE_INT(pL, "arena",  stats.arena,  -3);
+	return 1;
+}
+
+/* lurchproc.spawn(argv, input?) -> pid. see rt/proc.lua. */
+int
+api_proc_spawn(lua_State *pL)
+{
+	luaL_checktype(pL, 1, LUA_TTABLE);
+	size_t inlen = 0;
+	const char *input = luaL_optlstring(pL, 2, NULL, &inlen);
+
+	size_t argc = llua_rawlen(pL, 1);
+	if (argc == 0)
+		return luaL_argerror(pL, 1, "no command given");
+
+	/* the strings stay on the stack (and so alive) until we return. */
+	char **argv = lua_newuserdata(pL, (argc + 1) * sizeof(char *));
+	for (size_t i = 0; i < argc; ++i) {
+		lua_rawgeti(pL, 1, i + 1);
+		argv[i] = (char *) lua_tostring(pL, -1);
+		if (!argv[i])
+			return luaL_argerror(pL, 1, "arguments must be strings");
+	}
+	argv[argc] = NULL;
+
+	pid_t pid = proc_spawn(argv, input, inlen);
+	if (pid < 0)
+		LLUA_ERR(pL, format("%s: %s", argv[0], strerror(errno)));
+
+	lua_pushinteger(pL, (lua_Integer) pid);
+	return 1;
+}
+
+int
+api_proc_kill(lua_State *pL)
+{
+	pid_t pid = (pid_t) luaL_checkinteger(pL, 1);
+	int sig = (int) luaL_optinteger(pL, 2, SIGTERM);
+
+	if (proc_kill(pid, sig) < 0)
+		LLUA_ERR(pL, format("%s", strerror(errno)));
+
+	lua_pushboolean(pL, true);
+	return 1;
+}
+
+int
+api_proc_running(lua_State *pL)
+{
+	lua_pushinteger(pL, (lua_Integer) proc_running());
+	return 1;
+}
@@ -11,6 +11,7 @@ int api_conn_init(lua_State *pL);
 int api_conn_send(lua_State *pL);
 int api_conn_active(lua_State *pL);
 int api_conn_close(lua_State *pL);
+int api_conn_resumed(lua_State *pL);
 int api_tb_shutdown(lua_State *pL);
 int api_tb_size(lua_State *pL);
 int api_tb_clear(lua_State *pL);
@@ -18,5 +19,51 @@ int api_tb_writeline(lua_State *pL);
 int api_tb_setcursor(lua_State *pL);
 int api_utf8_insert(lua_State *pL);
 int api_utf8_dwidth(lua_State *pL);
+int api_utf8_window(lua_State *pL);
+int api_edit_new(lua_State *pL);
+int api_edit_insert(lua_State *pL);
+int api_edit_delete(lua_State *pL);
+int api_edit_kill(lua_State *pL);
+int api_edit_yank(lua_State *pL);
+int api_edit_move(lua_State *pL);
+int api_edit_word(lua_State *pL);
+int api_edit_undo(lua_State *pL);
+int api_edit_set(lua_State *pL);
+int api_edit_text(lua_State *pL);
+int api_edit_cursor(lua_State *pL);
+int api_edit_len(lua_State *pL);
+int api_edit_column(lua_State *pL);
+int api_edit_gc(lua_State *pL);
+int api_hist_new(lua_State *pL);
+int api_hist_push(lua_State *pL);
+int api_hist_insert(lua_State *pL);
+int api_hist_clear(lua_State *pL);
+int api_hist_get(lua_State *pL);
+int api_hist_bytes(lua_State *pL);
+int api_hist_layout(lua_State *pL);
+int api_hist_fold(lua_State *pL);
+int api_hist_rows(lua_State *pL);
+int api_hist_locate(lua_State *pL);
+int api_hist_search(lua_State *pL);
+int api_hist_index(lua_State *pL);
+int api_hist_len(lua_State *pL);
+int api_hist_gc(lua_State *pL);
+int api_proc_spawn(lua_State *pL);
+int api_proc_kill(lua_State *pL);
+int api_proc_running(lua_State *pL);
+int api_log_list(lua_State *pL);
+int api_log_search(lua_State *pL);
+int api_log_size(lua_State *pL);
+int api_log_tail(lua_State *pL);
+int api_color_palette(lua_State *pL);
+int api_color_color(lua_State *pL);
+int api_color_prefix(lua_State *pL);
+int api_time_parse(lua_State *pL);
+int api_time_now(lua_State *pL);
+int api_time_at(lua_State *pL);
+int api_time_format(lua_State *pL);
+int api_time_iso(lua_State *pL);
+int api_mem_phase(lua_State *pL);
+int api_mem_stats(lua_State *pL);
 
 #endif
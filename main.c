@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <lauxlib.h>
 #include <lua.h>
 #include <lualib.h>
@@ -17,10 +18,12 @@
 #include <unistd.h>
 #include <utf8proc.h>
 
+#include "alloc.h"
 #include "dwidth.h"
 #include "luau.h"
 #include "luaa.h"
 #include "mirc.h"
+#include "proc.h"
 #include "termbox.h"
 #include "util.h"
 
@@ -48,13 +51,91 @@ _Bool reconn = false;
 _Bool tls_active = false;
 struct tls *client = NULL;
 
+/*
+ * signals that are handled in Lua aren't handled in the signal handler
+ * itself, as that could interrupt the Lua VM halfway through something.
+ * instead, the handler notes which signal arrived and writes to sigpipe,
+ * which wakes up select(2) in the main loop; rt.on_signal is then called
+ * from there, once for each kind of signal that arrived since the last
+ * time around the loop.
+ */
+static int sigpipe[2] = { -1, -1 };
+static volatile sig_atomic_t sig_pending[NSIG];
+
+/* termbox's SIGWINCH handler, which we have to pass SIGWINCH on to. */
+static struct sigaction tb_winch;
+
 static void
 signal_lhand(int sig)
+{
+	int saved_errno = errno;
+	sig_pending[sig] = 1;
+	(void) !write(sigpipe[1], "", 1);
+	errno = saved_errno;
+}
+
+/* SIGCHLD only has to wake up the main loop, which reaps children
+ * every time around. (see proc_handle) */
+static void
+signal_wake(int sig)
+{
+	UNUSED(sig);
+	int saved_errno = errno;
+	(void) !write(sigpipe[1], "", 1);
+	errno = saved_errno;
+}
+
+static void
+signal_winch(int sig)
+{
+	signal_lhand(sig);
+	if (!(tb_winch.sa_flags & SA_SIGINFO) && tb_winch.sa_handler != SIG_DFL
+			&& tb_winch.sa_handler != SIG_IGN)
+		(tb_winch.sa_handler)(sig);
+}
+
+static void
+signal_dispatch(int sig)
 {
 	lua_pushinteger(L, (lua_Integer) sig);
 	llua_call(L, "on_signal", 1, 0);
 }
 
+static void
+input_dispatch(struct tb_event *ev)
+{
+	/* don't push event.w and event.y; the Lua
+	 * code can easily get those values by running
+	 * termbox.size() */
+	lua_settop(L, 0);
+	lua_newtable(L);
+	SETTABLE_INT(L, "type",   ev->type, -3);
+	SETTABLE_INT(L, "mod",    ev->mod,  -3);
+	SETTABLE_INT(L, "ch",     ev->ch,   -3);
+	SETTABLE_INT(L, "key",    ev->key,  -3);
+	SETTABLE_INT(L, "mousex", ev->x,    -3);
+	SETTABLE_INT(L, "mousey", ev->y,    -3);
+	llua_call(L, "on_input", 1, 0);
+}
+
+static void
+proc_dispatch(pid_t pid, enum proc_event ev, const char *data, size_t len, int code)
+{
+	static const char *events[] = {
+		[PROC_STDOUT] = "stdout", [PROC_STDERR] = "stderr",
+		[PROC_EXIT] = "exit",
+	};
+
+	lua_settop(L, 0);
+	lua_pushinteger(L, (lua_Integer) pid);
+	lua_pushstring(L, events[ev]);
+	if (ev == PROC_EXIT)
+		lua_pushinteger(L, (lua_Integer) code);
+	else
+		lua_pushlstring(L, data, len);
+	llua_call(L, "on_proc", 3, 0);
+}
+
 static const char *sigstrs[] = { [SIGILL]  = "SIGILL", [SIGSEGV] = "SIGSEGV",
 	[SIGFPE]  = "SIGFPE", [SIGBUS]  = "SIGBUS", };
 
@@ -90,23 +171,35 @@ main(int argc, char **argv)
 	/* signals to whine and die on: */
 	struct sigaction fatal;
 	fatal.sa_handler = &signal_fatal;
+	fatal.sa_flags = 0;
+	sigemptyset(&fatal.sa_mask);
 	sigaction(SIGILL,   &fatal, NULL);
 	sigaction(SIGSEGV,  &fatal, NULL);
 	sigaction(SIGFPE,   &fatal, NULL);
 	sigaction(SIGBUS,   &fatal, NULL);
 
 	/* signals to catch and handle in lua code: */
+	if (pipe2(sigpipe, O_NONBLOCK | O_CLOEXEC) < 0)
+		die("couldn't create signal pipe:");
+
 	struct sigaction lhand;
 	lhand.sa_handler = &signal_lhand;
+	lhand.sa_flags = 0;
+	sigemptyset(&lhand.sa_mask);
 	sigaction(SIGHUP,   &lhand, NULL);
 	sigaction(SIGINT,   &lhand, NULL);
 	sigaction(SIGPIPE,  &lhand, NULL);
 	sigaction(SIGUSR1,  &lhand, NULL);
 	sigaction(SIGUSR2,  &lhand, NULL);
-	sigaction(SIGWINCH, &lhand, NULL);
+
+	struct sigaction wake;
+	wake.sa_handler = &signal_wake;
+	wake.sa_flags = SA_NOCLDSTOP;
+	sigemptyset(&wake.sa_mask);
+	sigaction(SIGCHLD,  &wake, NULL);
 
 	/* init lua */
-	L = luaL_newstate();
+	L = lua_newstate(alloc_lua, NULL);
 	assert(L);
 
 	luaL_openlibs(L);
@@ -145,6 +238,13 @@ main(int argc, char **argv)
 	luaL_requiref(L, "lurchconn", llua_openlib, false);
 	luaL_requiref(L, "termbox", llua_openlib, false);
 	luaL_requiref(L, "utf8utils", llua_openlib, false);
+	luaL_requiref(L, "lurchlog", llua_openlib, false);
+	luaL_requiref(L, "lurchmem", llua_openlib, false);
+	luaL_requiref(L, "lurchedit", llua_openlib, false);
+	luaL_requiref(L, "lurchtime", llua_openlib, false);
+	luaL_requiref(L, "lurchcolor", llua_openlib, false);
+	luaL_requiref(L, "lurchhist", llua_openlib, false);
+	luaL_requiref(L, "lurchproc", llua_openlib, false);
 
 	!luaL_dofile(L, "./rt/init.lua") || llua_panic(L);
 	lua_setglobal(L, "rt");
@@ -162,6 +262,14 @@ main(int argc, char **argv)
 	tb_select_input_mode(TB_INPUT_ALT|TB_INPUT_MOUSE);
 	tb_select_output_mode(TB_OUTPUT_256);
 
+	/* tb_init() sets up its own SIGWINCH handler, which ours has to
+	 * call in turn, so this has to be done afterwards. */
+	struct sigaction winch;
+	winch.sa_handler = &signal_winch;
+	winch.sa_flags = 0;
+	sigemptyset(&winch.sa_mask);
+	sigaction(SIGWINCH, &winch, &tb_winch);
+
 	/* run init function */
 	lua_settop(L, 0);
 	lua_newtable(L);
@@ -178,7 +286,7 @@ main(int argc, char **argv)
 	 * tpresent: last time tb_present() was called.
 	 * tcurrent: buffer for gettimeofday(2).
 	 */
-	struct timeval ttimeout = { 5, 500 };
+	struct timeval ttimeout = { 1,   0 };
 	struct timeval tpresent = { 0,   0 };
 	struct timeval tcurrent = { 0,   0 };
 
@@ -187,7 +295,7 @@ main(int argc, char **argv)
 
 	/* select(2) stuff */
 	int n = 0;
-	fd_set rd;
+	fd_set rd, wr;
 
 	/* buffer for incoming server data. */
 	char bufsrv[4096];
@@ -199,17 +307,26 @@ main(int argc, char **argv)
 	 * mouse clicks, etc */
 	struct tb_event ev;
 
+	/* whether the terminal was resized since the last frame. */
+	_Bool resized = false;
+
 	while ("pigs fly") {
 		tb_try_present(&tcurrent, &tpresent);
 
-		ttimeout.tv_sec  =   5;
-		ttimeout.tv_usec = 500;
+		/* wake up at least once a second, so that rt.on_tick
+		 * can be called even when nothing's happening. */
+		ttimeout.tv_sec  =   1;
+		ttimeout.tv_usec =   0;
 
 		FD_ZERO(&rd);
+		FD_ZERO(&wr);
 		FD_SET(STDIN_FILENO, &rd);
+		FD_SET(sigpipe[0], &rd);
 		if (!reconn) FD_SET(conn_fd, &rd);
 
-		n = select(conn_fd + 1, &rd, 0, 0, &ttimeout);
+		int maxfd = conn_fd > sigpipe[0] ? conn_fd : sigpipe[0];
+		proc_fdset(&rd, &wr, &maxfd);
+		n = select(maxfd + 1, &rd, &wr, 0, &ttimeout);
 
 		if (n < 0) {
 			if (errno == EINTR)
@@ -217,6 +334,13 @@ main(int argc, char **argv)
 			die("error on select():");
 		}
 
+		/* nothing's happening, so take the opportunity to do
+		 * some garbage collection. */
+		if (n == 0)
+			lua_gc(L, LUA_GCSTEP, 0);
+
+		proc_handle(&rd, &wr, proc_dispatch);
+
 		if (reconn) {
 			lua_pushstring(L, (const char *) NETWRK_ERR());
 			llua_call(L, "on_disconnect", 1, 1);
@@ -243,6 +367,12 @@ main(int argc, char **argv)
 			rc += r;
 			bufsrv[rc] = '\0';
 
+			/*
+			 * don't let the collector run while we're handling
+			 * a burst of messages; it catches up afterwards.
+			 */
+			lua_gc(L, LUA_GCSTOP, 0);
+
 			char *end = NULL;
 			char *ptr = (char *) &bufsrv;
 			while ((end = memmem(ptr, &bufsrv[rc] - ptr, "\r\n", 2))) {
@@ -254,29 +384,57 @@ main(int argc, char **argv)
 				ptr = end + 2;
 			}
 
+			lua_gc(L, LUA_GCRESTART, 0);
+
 			rc -= ptr - bufsrv;
 			memmove(&bufsrv, ptr, rc);
 		}
 
-		if (FD_ISSET(STDIN_FILENO, &rd)) {
+		/*
+		 * when the terminal is resized, termbox only notices when
+		 * it's next asked for events, so check for those right away
+		 * if there was a SIGWINCH.
+		 */
+		if (FD_ISSET(sigpipe[0], &rd)) {
+			char drain[64];
+			while (read(sigpipe[0], &drain, sizeof(drain)) > 0);
+
+			if (sig_pending[SIGWINCH]) {
+				sig_pending[SIGWINCH] = 0;
+				resized = true;
+			}
+		}
+
+		if (FD_ISSET(STDIN_FILENO, &rd) || resized) {
 			int ret = 0;
-			while ((ret = tb_peek_event(&ev, 16)) != 0) {
+			int wait = FD_ISSET(STDIN_FILENO, &rd) ? 16 : 0;
+			while ((ret = tb_peek_event(&ev, wait)) != 0) {
 				assert(ret != -1); /* termbox error */
 
-				/* don't push event.w and event.y; the Lua
-				 * code can easily get those values by running
-				 * termbox.size() */
-				lua_settop(L, 0);
-				lua_newtable(L);
-				SETTABLE_INT(L, "type",   ev.type, -3);
-				SETTABLE_INT(L, "mod",    ev.mod,  -3);
-				SETTABLE_INT(L, "ch",     ev.ch,   -3);
-				SETTABLE_INT(L, "key",    ev.key,  -3);
-				SETTABLE_INT(L, "mousex", ev.x,    -3);
-				SETTABLE_INT(L, "mousey", ev.y,    -3);
-				llua_call(L, "on_input", 1, 0);
+				/* resizes are handled all at once, below. */
+				if (ev.type == TB_EVENT_RESIZE)
+					resized = true;
+				else
+					input_dispatch(&ev);
 			}
 		}
+
+		/* SIGWINCH is left to the check above, so that a resize
+		 * isn't handled twice. */
+		for (int sig = 1; sig < NSIG; ++sig) {
+			if (sig == SIGWINCH || !sig_pending[sig]) continue;
+			sig_pending[sig] = 0;
+			signal_dispatch(sig);
+		}
+
+		/* however many times the terminal was resized since the
+		 * last frame, only relayout once. */
+		if (resized) {
+			resized = false;
+			signal_dispatch(SIGWINCH);
+		}
+
+		llua_call(L, "on_tick", 0, 0);
 	}
 
 	cleanup();
@@ -0,0 +1,183 @@
+/*
+ * nickname colours.
+ *
+ * each nickname (or channel name) gets a colour from the palette in
+ * conf/colors, picked using a hash of the name. the escape sequences
+ * that set each name's colour are kept in a small LRU cache, so that
+ * highlighting the same few names over and over doesn't mean hashing
+ * them and building the sequences each time.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "nickcol.h"
+
+#define NICKCOL_PALETTE 256
+#define NICKCOL_CACHE   256
+#define NICKCOL_BUCKETS 512
+#define NICKCOL_KEYMAX  64
+
+#define MIRC_BOLD     "\x02"
+#define MIRC_256COLOR "\x04"
+
+struct nickcol_ent {
+	char   key[NICKCOL_KEYMAX];
+	size_t len;
+	char   bold[8], plain[8];           /* the escape sequences */
+
+	struct nickcol_ent *next;           /* in the same bucket */
+	struct nickcol_ent *newer, *older;  /* in the LRU list */
+	size_t bucket;
+};
+
+static int palette[NICKCOL_PALETTE];
+static size_t npalette = 0;
+
+static struct nickcol_ent cache[NICKCOL_CACHE];
+static size_t ncache = 0;
+static struct nickcol_ent *buckets[NICKCOL_BUCKETS];
+static struct nickcol_ent *newest = NULL, *oldest = NULL;
+
+/*
+ * this has to give the same results as it always has (it used to be
+ * done on Lua integers in tui.fnl), or everyone's colours would change.
+ */
+static uint64_t
+hash(const char *s, size_t len)
+{
+	uint64_t h = 0;
+	for (size_t i = 0; i < len; ++i) {
+		h ^= (unsigned char) s[i];
+		h *= 0x5be7413b;
+		h ^= h >> 15;
+	}
+
+	/* "avalanche" */
+	h += h << 3;
+	h ^= h >> 23;
+	h += h << 15;
+	return h;
+}
+
+/* pick a colour for a hash, or -1 if there's no palette. */
+static int
+pick(uint64_t h)
+{
+	if (npalette == 0)
+		return -1;
+	if (npalette == 1)
+		return palette[0];
+
+	/* as before, the hash is taken modulo one less than the number
+	 * of colours (so the last one is never used), with the result
+	 * of Lua's (floored) modulo. */
+	int64_t m = (int64_t) npalette - 1;
+	int64_t r = (int64_t) h % m;
+	if (r < 0) r += m;
+	return palette[r];
+}
+
+static void
+unlink_lru(struct nickcol_ent *e)
+{
+	if (e->newer) e->newer->older = e->older;
+	else          newest = e->older;
+	if (e->older) e->older->newer = e->newer;
+	else          oldest = e->newer;
+	e->newer = e->older = NULL;
+}
+
+static void
+push_lru(struct nickcol_ent *e)
+{
+	e->older = newest;
+	e->newer = NULL;
+	if (newest) newest->newer = e;
+	newest = e;
+	if (!oldest) oldest = e;
+}
+
+static struct nickcol_ent *
+lookup(const char *key, size_t len)
+{
+	uint64_t h = hash(key, len);
+	size_t b = h % NICKCOL_BUCKETS;
+
+	for (struct nickcol_ent *e = buckets[b]; e; e = e->next) {
+		if (e->len == len && !memcmp(e->key, key, len)) {
+			unlink_lru(e);
+			push_lru(e);
+			return e;
+		}
+	}
+
+	/* names too long to be cached don't get a cache entry; there
+	 * shouldn't be many of those. */
+	static struct nickcol_ent uncached;
+	struct nickcol_ent *e = &uncached;
+
+	if (len < NICKCOL_KEYMAX) {
+		if (ncache < NICKCOL_CACHE) {
+			e = &cache[ncache++];
+		} else {
+			/* evict the least recently used name. */
+			e = oldest;
+			unlink_lru(e);
+			struct nickcol_ent **p = &buckets[e->bucket];
+			while (*p != e) p = &(*p)->next;
+			*p = e->next;
+		}
+
+		memcpy(e->key, key, len);
+		e->len = len;
+		e->bucket = b;
+		e->next = buckets[b];
+		buckets[b] = e;
+		push_lru(e);
+	}
+
+	int color = pick(h);
+	if (color < 0) {
+		strcpy(e->bold, MIRC_BOLD);
+		e->plain[0] = '\0';
+	} else {
+		snprintf(e->bold, sizeof(e->bold), "%s%s%03d", MIRC_BOLD,
+			MIRC_256COLOR, color % 1000);
+		snprintf(e->plain, sizeof(e->plain), "%s%03d", MIRC_256COLOR,
+			color % 1000);
+	}
+
+	return e;
+}
+
+/* set the colours that names are given, and forget the old ones. */
+void
+nickcol_palette(const int *colors, size_t ncolors)
+{
+	if (ncolors > NICKCOL_PALETTE)
+		ncolors = NICKCOL_PALETTE;
+	memcpy(palette, colors, ncolors * sizeof(int));
+	npalette = ncolors;
+
+	memset(buckets, 0x0, sizeof(buckets));
+	ncache = 0;
+	newest = oldest = NULL;
+}
+
+/* the colour a name is given, or -1 if there's no palette. */
+int
+nickcol_color(const char *key, size_t len)
+{
+	return pick(hash(key, len));
+}
+
+/* the escape sequence that sets a name's colour (and bold). */
+const char *
+nickcol_prefix(const char *key, size_t len, _Bool bold)
+{
+	struct nickcol_ent *e = lookup(key, len);
+	return bold ? e->bold : e->plain;
+}
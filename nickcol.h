@@ -0,0 +1,10 @@
+#ifndef NICKCOL_H
+#define NICKCOL_H
+
+#include <stddef.h>
+
+void        nickcol_palette(const int *colors, size_t ncolors);
+int         nickcol_color(const char *key, size_t len);
+const char *nickcol_prefix(const char *key, size_t len, _Bool bold);
+
+#endif
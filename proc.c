@@ -0,0 +1,228 @@
+/*
+ * child processes that run alongside the UI (see rt/proc.lua).
+ *
+ * running a command with io.popen or os.execute blocks everything,
+ * input and the connection included, until the command exits. instead,
+ * children are started with posix_spawn, and their stdin, stdout and
+ * stderr are pipes that the main loop selects on along with everything
+ * else; output is passed on as it arrives.
+ *
+ * children are reaped each time around the main loop, which SIGCHLD
+ * wakes up. a child is only reported as finished once it has exited
+ * and both its stdout and stderr have been read to the end, so that
+ * no output arrives after its exit.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "proc.h"
+#include "util.h"
+
+struct proc {
+	pid_t  pid;        /* 0 if the slot is free */
+	int    fd[3];      /* our ends of the child's stdin, stdout, stderr */
+	char  *input;      /* what's left to write to the child's stdin */
+	size_t inlen, inoff;
+	_Bool  exited;
+	int    code;
+};
+
+static struct proc procs[PROC_MAX];
+
+static void
+closefd(int *fd)
+{
+	if (*fd != -1) close(*fd);
+	*fd = -1;
+}
+
+static void
+closepipe(int p[2])
+{
+	closefd(&p[0]);
+	closefd(&p[1]);
+}
+
+/*
+ * start a child, and feed it input (if any) on its stdin; if there's
+ * no input, its stdin is /dev/null. returns the child's pid, or -1
+ * (setting errno) if it couldn't be started.
+ */
+pid_t
+proc_spawn(char *const argv[], const char *input, size_t len)
+{
+	struct proc *p = NULL;
+	for (size_t i = 0; i < PROC_MAX && !p; ++i)
+		if (procs[i].pid == 0) p = &procs[i];
+	if (!p) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	/* all of these are close-on-exec; the child gets copies made
+	 * by dup2, which aren't. */
+	int in[2] = { -1, -1 }, out[2] = { -1, -1 }, err[2] = { -1, -1 };
+	if ((input && pipe2(in, O_CLOEXEC) < 0) || pipe2(out, O_CLOEXEC) < 0
+			|| pipe2(err, O_CLOEXEC) < 0)
+		goto fail;
+
+	posix_spawn_file_actions_t fa;
+	posix_spawn_file_actions_init(&fa);
+	if (input)
+		posix_spawn_file_actions_adddup2(&fa, in[0], STDIN_FILENO);
+	else
+		posix_spawn_file_actions_addopen(&fa, STDIN_FILENO,
+			"/dev/null", O_RDONLY, 0);
+	posix_spawn_file_actions_adddup2(&fa, out[1], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&fa, err[1], STDERR_FILENO);
+
+	pid_t pid;
+	int e = posix_spawnp(&pid, argv[0], &fa, NULL, argv, environ);
+	posix_spawn_file_actions_destroy(&fa);
+	if (e != 0) {
+		errno = e;
+		goto fail;
+	}
+
+	closefd(&in[0]);
+	closefd(&out[1]);
+	closefd(&err[1]);
+
+	memset(p, 0, sizeof(*p));
+	p->pid = pid;
+	p->fd[0] = in[1];
+	p->fd[1] = out[0];
+	p->fd[2] = err[0];
+	for (size_t i = 0; i < 3; ++i)
+		if (p->fd[i] != -1)
+			fcntl(p->fd[i], F_SETFL, fcntl(p->fd[i], F_GETFL) | O_NONBLOCK);
+
+	if (input) {
+		if ((p->input = malloc(len ? len : 1)) == NULL)
+			die("couldn't allocate memory for child's input:");
+		memcpy(p->input, input, len);
+		p->inlen = len;
+	}
+
+	return pid;
+
+fail:
+	e = errno;
+	closepipe(in);
+	closepipe(out);
+	closepipe(err);
+	errno = e;
+	return -1;
+}
+
+int
+proc_kill(pid_t pid, int sig)
+{
+	for (size_t i = 0; i < PROC_MAX; ++i)
+		if (procs[i].pid == pid && pid != 0 && !procs[i].exited)
+			return kill(pid, sig);
+	errno = ESRCH;
+	return -1;
+}
+
+size_t
+proc_running(void)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < PROC_MAX; ++i)
+		if (procs[i].pid != 0) ++n;
+	return n;
+}
+
+void
+proc_fdset(fd_set *rd, fd_set *wr, int *maxfd)
+{
+	for (size_t i = 0; i < PROC_MAX; ++i) {
+		struct proc *p = &procs[i];
+		if (p->pid == 0) continue;
+
+		if (p->fd[0] != -1) FD_SET(p->fd[0], wr);
+		if (p->fd[1] != -1) FD_SET(p->fd[1], rd);
+		if (p->fd[2] != -1) FD_SET(p->fd[2], rd);
+
+		for (size_t f = 0; f < 3; ++f)
+			if (p->fd[f] > *maxfd) *maxfd = p->fd[f];
+	}
+}
+
+static void
+feed(struct proc *p)
+{
+	while (p->inoff < p->inlen) {
+		ssize_t w = write(p->fd[0], &p->input[p->inoff],
+			p->inlen - p->inoff);
+		if (w < 0 && errno == EINTR) continue;
+		if (w < 0 && errno == EAGAIN) return;
+
+		/* the child closed its stdin (or worse); it doesn't
+		 * want the rest. */
+		if (w < 0) break;
+		p->inoff += w;
+	}
+
+	closefd(&p->fd[0]);
+	free(p->input);
+	p->input = NULL;
+}
+
+static void
+drain(struct proc *p, size_t f, proc_fn fn)
+{
+	char buf[4096];
+	ssize_t r = read(p->fd[f], buf, sizeof(buf));
+
+	if (r > 0)
+		(fn)(p->pid, f == 1 ? PROC_STDOUT : PROC_STDERR, buf, r, 0);
+	else if (r == 0 || (errno != EINTR && errno != EAGAIN))
+		closefd(&p->fd[f]);
+}
+
+/* handle whatever select(2) found on the children's pipes, then
+ * reap those that have exited. */
+void
+proc_handle(fd_set *rd, fd_set *wr, proc_fn fn)
+{
+	for (size_t i = 0; i < PROC_MAX; ++i) {
+		struct proc *p = &procs[i];
+		if (p->pid == 0) continue;
+
+		if (p->fd[0] != -1 && FD_ISSET(p->fd[0], wr))
+			feed(p);
+		for (size_t f = 1; f < 3; ++f)
+			if (p->fd[f] != -1 && FD_ISSET(p->fd[f], rd))
+				drain(p, f, fn);
+
+		int status;
+		if (!p->exited && waitpid(p->pid, &status, WNOHANG) == p->pid) {
+			p->exited = true;
+			if (WIFEXITED(status))
+				p->code = WEXITSTATUS(status);
+			else if (WIFSIGNALED(status))
+				p->code = 128 + WTERMSIG(status);
+		}
+
+		if (p->exited && p->fd[1] == -1 && p->fd[2] == -1) {
+			pid_t pid = p->pid;
+			int code = p->code;
+
+			closefd(&p->fd[0]);
+			free(p->input);
+			memset(p, 0, sizeof(*p));
+
+			(fn)(pid, PROC_EXIT, NULL, 0, code);
+		}
+	}
+}
@@ -0,0 +1,29 @@
+#ifndef PROC_H
+#define PROC_H
+
+#include <stddef.h>
+#include <sys/select.h>
+#include <sys/types.h>
+
+/* the most child processes that can be running at once. rt/proc.lua
+ * queues anything past its own (lower) limit, so this is rarely hit. */
+#define PROC_MAX 32
+
+enum proc_event { PROC_STDOUT, PROC_STDERR, PROC_EXIT };
+
+/*
+ * called with the output of a child as it arrives, and then once the
+ * child has exited and all of its output was read. for PROC_EXIT, data
+ * is NULL and code is the exit status (or 128 + the signal that killed
+ * the child, as shells do).
+ */
+typedef void (*proc_fn)(pid_t pid, enum proc_event ev,
+		const char *data, size_t len, int code);
+
+pid_t proc_spawn(char *const argv[], const char *input, size_t len);
+int   proc_kill(pid_t pid, int sig);
+size_t proc_running(void);
+void  proc_fdset(fd_set *rd, fd_set *wr, int *maxfd);
+void  proc_handle(fd_set *rd, fd_set *wr, proc_fn fn);
+
+#endif
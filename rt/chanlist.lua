@@ -0,0 +1,140 @@
+-- The channel list, as sent by the server in reply to LIST. On large
+-- networks that's tens of thousands of lines (one 322 per channel), far
+-- too many to print and log one at a time. Instead, they are collected
+-- here as they arrive, and shown through M.view, which buffers use in
+-- place of their history (see tui.buffer_text): only the rows that are
+-- on screen are ever formatted.
+--
+-- The list can be sorted and filtered while it's still arriving; new
+-- channels are sorted on their own and merged into the list the next
+-- time it's looked at, rather than resorting everything each time.
+
+local M = {}
+
+-- the channels, one column per field, in the order they arrived.
+M.names  = {}
+M.users  = {}
+M.topics = {}
+M.lower  = {}   -- lowercased name and topic, for filtering
+
+M.done   = true    -- whether the server has sent the end of the list
+                   -- (or there isn't one coming)
+M.sort   = "users" -- "users" (most first) or "name"
+M.filter = nil     -- only show channels with this in their name or topic
+
+M.order   = {}  -- indices of the channels shown, in order
+M.pending = {}  -- indices of the channels not yet merged into M.order
+
+local function before(a, b)
+    if M.sort == "users" and M.users[a] ~= M.users[b] then
+        return M.users[a] > M.users[b]
+    end
+    if M.names[a] ~= M.names[b] then
+        return M.names[a] < M.names[b]
+    end
+    return a < b
+end
+
+local function matches(i)
+    return not M.filter or M.lower[i]:find(M.filter, 1, true) ~= nil
+end
+
+-- forget the previous list, ready for a new one.
+function M.begin()
+    M.names, M.users, M.topics, M.lower = {}, {}, {}, {}
+    M.order, M.pending = {}, {}
+    M.done = false
+end
+
+function M.add(name, users, topic)
+    local i = #M.names + 1
+    M.names[i]  = name
+    M.users[i]  = tonumber(users) or 0
+    M.topics[i] = topic or ""
+    M.lower[i]  = (name .. " " .. (topic or "")):lower()
+
+    if matches(i) then M.pending[#M.pending + 1] = i end
+end
+
+function M.finish()
+    M.done = true
+end
+
+-- the number of channels received so far.
+function M.count()
+    return #M.names
+end
+
+-- sort the channels that arrived since the list was last looked at, and
+-- merge them into the rest.
+function M.merge()
+    if #M.pending == 0 then return end
+
+    local new = M.pending
+    M.pending = {}
+    table.sort(new, before)
+
+    local old, out = M.order, {}
+    local o, n = 1, 1
+    while o <= #old or n <= #new do
+        if n > #new or (o <= #old and not before(new[n], old[o])) then
+            out[#out + 1] = old[o]; o = o + 1
+        else
+            out[#out + 1] = new[n]; n = n + 1
+        end
+    end
+    M.order = out
+end
+
+-- change how the list is sorted and filtered. Both are kept as-is if
+-- nil; an empty filter shows everything again.
+function M.set_view(sort, filter)
+    if sort then M.sort = sort end
+    if filter then
+        M.filter = filter ~= "" and filter:lower() or nil
+    end
+
+    M.order, M.pending = {}, {}
+    for i = 1, #M.names do
+        if matches(i) then M.pending[#M.pending + 1] = i end
+    end
+end
+
+-- the channel shown on a row: its name, user count, and topic.
+function M.row(r)
+    M.merge()
+    local i = M.order[r]
+    if not i then return nil end
+    return M.names[i], M.users[i], M.topics[i]
+end
+
+-- the number of channels shown.
+function M.rows()
+    return #M.order + #M.pending
+end
+
+-- the list as buffer lines ({ time, left, right }, like the lines of a
+-- buffer's history), for tui.buffer_text and buf_scroll. Buffers are
+-- drawn from the bottom up, so the list is upside down: the first
+-- channel is on the last line, where it's seen without scrolling.
+--
+-- Unlike a history, the view is scrolled by lines, not rows; as with a
+-- history, locate returns the line at the bottom of the screen and how
+-- many of its rows are hidden below it.
+M.view = setmetatable({
+    rows = function(_) return M.rows() end,
+    locate = function(_, scroll)
+        local r = M.rows() - scroll
+        if r < 1 then return 0, 0 end
+        return r, 0
+    end,
+}, {
+    __len = function() return M.rows() end,
+    __index = function(_, r)
+        local name, users, topic = M.row(M.rows() - r + 1)
+        if not name then return nil end
+        return { tostring(users), name, topic }
+    end,
+})
+
+return M
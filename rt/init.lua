@@ -23,6 +23,10 @@ local inspect = require('inspect')
 local irc       = require('irc')
 local callbacks = require('callbacks')
 local logs      = require('logs')
+local netsplit  = require('netsplit')
+local chanlist  = require('chanlist')
+local statusline = require('statusline')
+local proc      = require('proc')
 local mirc      = require('mirc')
 local util      = require('util')
 local tui       = require('tui')
@@ -30,6 +34,9 @@ local tb        = require('tb')
 local termbox   = require('termbox')
 local tbrl      = require('tbrl')
 local lurchconn = require('lurchconn')
+local lurchmem  = require('lurchmem')
+local lurchtime = require('lurchtime')
+local lurchhist = require('lurchhist')
 
 local printf    = util.printf
 local eprintf   = util.eprintf
@@ -48,8 +55,10 @@ L_NORM  = config.leftfmt.normal
 L_AWAY  = config.leftfmt.away
 L_NICK  = config.leftfmt.nick
 
-SRVCONF = config.servers[config.server]
-DBGFILE = "/tmp/lurch_debug"
+SRVCONF   = config.servers[config.server]
+DBGFILE   = "/tmp/lurch_debug"
+RESULTBUF = "*search*"       -- Buffer for /search and /grep results.
+LISTBUF   = "*list*"         -- Buffer for the channel list. (see /list)
 
 reconn      = config.reconn  -- Number of times we've reconnected.
 reconn_wait = 5              -- Seconds to wait before reconnecting.
@@ -74,8 +83,10 @@ end
 
 -- a simple wrapper around tui.redraw.
 function redraw()
-    tui.redraw(tbrl.bufin[tbrl.hist], tbrl.cursor, config.time_col_width,
+    local phase = lurchmem.phase("render")
+    tui.redraw(tbrl.text(), tbrl.cursor, config.time_col_width,
         config.left_col_width, config.right_col_width)
+    lurchmem.phase(phase)
 end
 
 -- a simple wrapper around irc.send.
@@ -98,7 +109,7 @@ function buf_add(name)
     assert_t({name, "string", "name"})
 
     local newbuf = {}
-    newbuf.history = {}     -- lines in buffer.
+    newbuf.history = lurchhist.new(config.timefmt) -- lines in buffer.
     newbuf.name    = name
     newbuf.unreadh = 0      -- high-priority unread messages
     newbuf.unreadl = 0      -- low-priority unread messages
@@ -107,11 +118,62 @@ function buf_add(name)
     newbuf.names   = {}     -- nicknames in buffer/channel.
     newbuf.access  = {}     -- privilege for nicknames. (e.g. ~, @, +)
 
+    -- size of the buffer's log when the buffer was opened. The lines
+    -- before that are loaded into the history when the buffer is first
+    -- viewed. (see buf_backlog)
+    newbuf.backlog = nil
+    if config.backlog > 0 then
+        local logsz = logs.size(name)
+        if logsz and logsz > 0 then newbuf.backlog = logsz end
+    end
+
     local n_idx = #bufs + 1
     bufs[n_idx] = newbuf
     return n_idx
 end
 
+-- add a line to a buffer's history without drawing it or
+-- touching the buffer's unread notifications.
+function buf_append(idx, time, left, right, priority)
+    local buf = bufs[idx]
+    local phase = lurchmem.phase("history")
+    if buf.scroll > 0 and not buf.view then
+        -- the scroll offset counts from the bottom, so keep what's on
+        -- the screen where it is by scrolling up past the new line.
+        -- (buffers with a view are scrolled through that instead.)
+        local rows = buf.history:rows()
+        buf.history:push(time, left, right, priority)
+        buf.scroll = buf.scroll + (buf.history:rows() - rows)
+    else
+        buf.history:push(time, left, right, priority)
+    end
+    lurchmem.phase(phase)
+end
+
+-- insert several lines into a buffer's history at once, before the line
+-- at pos (or after the last line, if pos is nil). Each line is a table
+-- of { time, left, right, priority }.
+function buf_insert(idx, pos, lines)
+    local history = bufs[idx].history
+    pos = pos or #history + 1
+
+    local phase = lurchmem.phase("history")
+    history:insert(pos, lines)
+    lurchmem.phase(phase)
+
+    local lastread = bufs[idx].lastread
+    if lastread and pos <= lastread then
+        bufs[idx].lastread = lastread + #lines
+    end
+
+    -- likewise for where the history missed while disconnected goes
+    -- (e.g. when the backlog is loaded before it arrives).
+    local gap = bufs[idx].gap
+    if gap and pos <= gap.pos then
+        gap.pos = gap.pos + #lines
+    end
+end
+
 -- Clear all unread notifications for a buffer. statusline() should
 -- be run after this.
 function buf_read(idx)
@@ -124,9 +186,13 @@ function buf_read(idx)
     callbacks.on_cleared_unread(idx)
 end
 
+-- scroll a buffer by (or to) a number of rows up from the bottom.
 function buf_scroll(idx, rel, abs)
     assert(bufs[idx])
-    local bufsz = #bufs[idx].history
+    local lines = bufs[idx].view or bufs[idx].history
+
+    -- don't scroll further than the first row being at the top.
+    local max = math.max(0, lines:rows() - tui.text_height())
 
     if rel then
         bufs[idx].scroll = bufs[idx].scroll + rel
@@ -135,10 +201,18 @@ function buf_scroll(idx, rel, abs)
     end
 
     if bufs[idx].scroll < 0 then bufs[idx].scroll = 0 end
-    if bufs[idx].scroll > bufsz then bufs[idx].scroll = bufsz - 5 end
+    if bufs[idx].scroll > max then bufs[idx].scroll = max end
     if bufs[idx].scroll == 0 then buf_read(idx) end
 end
 
+-- scroll a buffer so that a line of its history is at the top of the
+-- screen, or as near as it can be.
+function buf_scroll_line(idx, line)
+    local history = bufs[idx].history
+    buf_scroll(idx, nil, history:rows() - history:rows(line - 1)
+        - tui.text_height())
+end
+
 -- check if a buffer exists, and if so, return the index
 -- for that buffer.
 function buf_idx(name)
@@ -170,6 +244,22 @@ function buf_with_nick(name, fn, mainbuf)
     end
 end
 
+-- call fn as though bufidx were the current buffer, then switch back
+-- (unless fn switched to another buffer itself). Buffers are looked up
+-- by name afterwards, since fn may have closed some of them.
+function buf_with_cur(bufidx, fn, ...)
+    if bufidx == cbuf then return fn(...) end
+
+    local cur, name = buf_cur(), bufs[bufidx].name
+    cbuf = bufidx
+    local ok, err = pcall(fn, ...)
+    if bufs[cbuf] and bufs[cbuf].name == name then
+        cbuf = buf_idx(cur) or cbuf
+        redraw()
+    end
+    if not ok then error(err, 0) end
+end
+
 function buf_addname(bufidx, name)
     bufs[bufidx].names[name] = true
     bufs[buf_idx(MAINBUF)].names[name] = true
@@ -178,8 +268,16 @@ end
 -- switch to a buffer and redraw the screen.
 function buf_switch(ch)
     if bufs[ch] then
+        -- remember how much of the buffer being left was seen, so
+        -- that we can go back there later. (see /jump)
+        if cbuf and bufs[cbuf] then
+            bufs[cbuf].lastread = #bufs[cbuf].history
+        end
+
         cbuf = ch
 
+        if bufs[ch].backlog then buf_backlog(ch) end
+
         -- reset scroll, unread notifications
         buf_read(ch)
         buf_scroll(ch, nil, 0)
@@ -208,48 +306,40 @@ function msg_pings(sender, msg)
     return false
 end
 
+-- get the time at which an irc message was sent, in the timezone the
+-- user wants.
+local function event_time(event)
+    -- if server-time is available, use that time instead of the
+    -- local time.
+    local srvtime = nil
+    if irc.server.caps["server-time"] then srvtime = event.tags.time end
+    return assert(lurchtime.at(config.tz, srvtime))
+end
+
+-- get how much the sender of an irc message is ignored (see
+-- config.ignores), or nil if they aren't.
+local function ignore_level(event)
+    for pat, lvl in pairs(config.ignores) do
+        local sndr = event.from
+        if sndr and (sndr):match(pat) then
+            return lvl:upper()
+        end
+    end
+    return nil
+end
+
 -- print a response to an irc message.
 local last_ircevent = nil
 function prin_irc(prio, dest, left, right_fmt, ...)
     assert(last_ircevent)
     local right = format(right_fmt, ...)
 
-    -- get the offset defined in the configuration and parse it.
-    local offset = assert(util.parse_offset(config.tz))
-    local time
-
-    local ignlvl = nil
-    for pat, lvl in pairs(config.ignores) do
-        local sndr = last_ircevent.from
-        if sndr and (sndr):match(pat) then
-            ignlvl = lvl:upper(); break
-        end
-    end
+    local ignlvl = ignore_level(last_ircevent)
 
     -- If the user is ignored, skip printing and logging.
     if ignlvl == "B" then return end
 
-    -- if server-time is available, use that time instead of the
-    -- local time.
-    if irc.server.caps["server-time"] and last_ircevent.tags.time then
-        -- the server-time is stored as a tag in the IRC message, in the
-        -- format yyyy-mm-ddThh:mm:ss.sssZ, but is in the UTC timezone.
-        -- convert it to the timezone the user wants.
-        local srvtime = last_ircevent.tags.time
-        local utc_time   = util.time_from_iso8601(srvtime)
-        time = utc_time + (offset * 60 * 60)
-    else
-        time = util.time_with_offset(offset)
-    end
-
-    -- Only log JOIN, PART, QUIT, MODE(+b), PRIVMSG, and NOTICE
-    -- because litterbox's unscoop utility ignores anything else
-    local last_cmd = last_ircevent.fields[1]
-    if last_cmd == "JOIN" or last_cmd == "PART"
-    or last_cmd == "QUIT" or last_cmd == "MODE"
-    or last_cmd == "PRIVMSG" or last_cmd == "NOTICE" then
-        logs.append(dest, last_ircevent)
-    end
+    local time = event_time(last_ircevent)
 
     -- If the user is dimmed, color the message/sender a light grey.
     if ignlvl == "D" then
@@ -258,9 +348,22 @@ function prin_irc(prio, dest, left, right_fmt, ...)
     end
 
     -- If the user is filtered, skip printing.
+    --
+    -- This is done before logging, as printing might open a new buffer
+    -- for dest; the line mustn't be in the log yet when it does, or it
+    -- would be shown again as part of the buffer's backlog. (see buf_add)
     if ignlvl ~= "F" then
         prin(prio, time, dest, left, right)
     end
+
+    -- Only log JOIN, PART, QUIT, MODE(+b), PRIVMSG, and NOTICE
+    -- because litterbox's unscoop utility ignores anything else
+    local last_cmd = last_ircevent.fields[1]
+    if last_cmd == "JOIN" or last_cmd == "PART"
+    or last_cmd == "QUIT" or last_cmd == "MODE"
+    or last_cmd == "PRIVMSG" or last_cmd == "NOTICE" then
+        logs.append(dest, last_ircevent)
+    end
 end
 
 -- print text in response to a command.
@@ -270,19 +373,23 @@ function prin_cmd(dest, left, right_fmt, ...)
     local priority = 1
     if left == L_ERR() then priority = 2 end
 
-    -- get the offset defined in the configuration and parse it.
-    local offset = assert(util.parse_offset(config.tz))
-
-    local now = util.time_with_offset(offset)
+    local now = assert(lurchtime.at(config.tz))
     prin(priority, now, dest, left, format(right_fmt, ...))
 end
 
+-- While an IRCv3 batch is being handled, prin() collects lines in
+-- batch_lines instead of adding them to the history one by one, and
+-- the screen is only redrawn once the whole batch has been handled.
+-- (see batch_commit)
+local batching     = 0      -- depth of (nested) batches being handled
+local batch_lines  = {}     -- lines to add, by buffer name
+local batch_redraw = false  -- whether to redraw the screen afterwards
+local batch_status = false  -- whether to redraw the statusline afterwards
+
 function prin(priority, time, dest, left, right)
     assert_t({time, "number", "time"}, {dest, "string", "dest"},
         {left, "string", "left"}, {right, "string", "right"})
 
-    local timestr = os.date(config.timefmt, time)
-
     -- keep track of whether we should redraw the statusline afterwards.
     local redraw_statusline = false
 
@@ -292,15 +399,30 @@ function prin(priority, time, dest, left, right)
         redraw_statusline = true
     end
 
+    -- keep track of the latest server-time in each buffer, so that we
+    -- know where to start when asking for the history we missed while
+    -- disconnected. (see rt.on_disconnect)
+    local srvtime = last_ircevent and last_ircevent.tags.time
+    if srvtime and (not bufs[bufidx].lastseen or srvtime > bufs[bufidx].lastseen) then
+        bufs[bufidx].lastseen = srvtime
+    end
+
     -- Add the output to the history and wait for it to be drawn.
-    local histsz = #bufs[bufidx].history
-    bufs[bufidx].history[histsz + 1] = { timestr, left, right }
+    if batching > 0 then
+        -- by name, as handlers might close buffers (and so move those
+        -- after them) before the batch is over.
+        batch_lines[dest] = batch_lines[dest] or {}
+        local lines = batch_lines[dest]
+        lines[#lines + 1] = { time, left, right, priority }
+    else
+        buf_append(bufidx, time, left, right, priority)
+    end
 
     -- if the buffer we're writing to is focused and is not scrolled up,
     -- draw the text; otherwise, add to the list of unread notifications
     local cb = bufs[cbuf]
     if dest == cb.name and cb.scroll == 0 then
-        redraw()
+        if batching > 0 then batch_redraw = true else redraw() end
     else
         if priority == 0 then
             bufs[bufidx].unreadl = bufs[bufidx].unreadl + 1
@@ -315,7 +437,112 @@ function prin(priority, time, dest, left, right)
             right, last_ircevent)
     end
 
-    if redraw_statusline then tui.statusline() end
+    if redraw_statusline then
+        if batching > 0 then batch_status = true else tui.statusline() end
+    end
+end
+
+-- handle the events of an IRCv3 batch that has ended (see irc.fnl),
+-- then add the resulting lines to the history in one go and redraw
+-- once.
+local function batch_commit(batch)
+    batching = batching + 1
+    for _, event in ipairs(batch.events) do
+        handle_ircevent(event)
+    end
+    batching = batching - 1
+
+    -- the lines of nested batches are added along with the outermost one.
+    if batching > 0 then return end
+
+    for dest, lines in pairs(batch_lines) do
+        local bufidx = buf_idx(dest)
+        if bufidx then
+            -- chathistory batches contain what we missed while we were
+            -- disconnected, so they go where we were disconnected.
+            local pos = nil
+            if batch.type == "chathistory" and bufs[bufidx].gap then
+                pos = bufs[bufidx].gap.pos
+                bufs[bufidx].gap = nil
+            end
+
+            buf_insert(bufidx, pos, lines)
+        end
+    end
+    batch_lines = {}
+
+    -- if nothing was missed, the batch is empty, but the gap is over
+    -- all the same.
+    if batch.type == "chathistory" and batch.params[1] then
+        local bufidx = buf_idx(batch.params[1])
+        if bufidx then bufs[bufidx].gap = nil end
+    end
+
+    if batch_redraw then
+        redraw()
+    elseif batch_status then
+        tui.statusline()
+    end
+    batch_redraw, batch_status = false, false
+end
+
+-- show each split (and netjoin) that's over as a single line in each
+-- buffer it affected, and log the quits (and joins) that were held
+-- back. (see netsplit.lua)
+-- get a quit or join ready to be held back until its split (or join) is
+-- over, or return false if it's not to be shown or logged at all.
+local function netsplit_hold(event)
+    event.ignlvl = ignore_level(event)
+    if event.ignlvl == "B" then return false end
+
+    -- it's logged when the split is over, but happened now.
+    if not event.tags.time then event.tags.time = lurchtime.iso() end
+    return true
+end
+
+local function netsplit_flush()
+    for _, g in ipairs(netsplit.finished()) do
+        for _, dest in ipairs(g.order) do
+            local d = g.dests[dest]
+            logs.append_many(dest, d.events)
+
+            -- leave out filtered users, as prin_irc would, and dim
+            -- those that are dimmed.
+            local listed = {}
+            for i, n in ipairs(d.nicks) do
+                local ignlvl = d.events[i].ignlvl
+                if ignlvl == "D" then
+                    listed[#listed + 1] = mirc.grey(n)
+                elseif ignlvl ~= "F" then
+                    listed[#listed + 1] = hncol(n)
+                end
+            end
+
+            -- don't reopen buffers that were closed in the meantime.
+            if buf_idx(dest) and #listed > 0 then
+                local shown = {}
+                for i = 1, math.min(#listed, config.netsplit_nicks) do
+                    shown[i] = listed[i]
+                end
+                local nicks = table.concat(shown, ", ")
+                if #listed > #shown then
+                    nicks = format("%s, and %d more", nicks, #listed - #shown)
+                end
+
+                local users = #listed == 1 and "user" or "users"
+                local time = event_time(d.events[1])
+
+                last_ircevent = nil
+                if g.kind == "split" then
+                    prin(0, time, dest, "<--", format("%d %s split (%s): %s",
+                        #listed, users, mirc.grey(g.servers), nicks))
+                else
+                    prin(0, time, dest, "-->", format("%d %s returned from split (%s): %s",
+                        #listed, users, mirc.grey(g.servers), nicks))
+                end
+            end
+        end
+    end
 end
 
 local function none(_) end
@@ -329,6 +556,33 @@ local function hndfact_err(m)
     end
 end
 
+-- when the link was lost, and the channels that are still being
+-- rejoined after reconnecting (and when the JOINs were sent), so that
+-- how long reconnecting and rejoining took can be reported. (see
+-- rt.on_disconnect and the 366 handler)
+local link_lost = nil
+local rejoining = nil
+
+-- whether channels have been added to the channel list since it was
+-- last drawn. (see rt.on_tick)
+local chanlist_dirty = false
+
+-- open the buffer that the channel list is shown in. If begin is set, a
+-- new list is starting: the old one is forgotten, and the buffer is
+-- switched to. Otherwise, the buffer was closed while the list was
+-- still arriving, and is only brought back.
+local function chanlist_open(begin)
+    if begin then chanlist.begin() end
+
+    local bufidx = buf_idx(LISTBUF)
+    if not bufidx then
+        bufidx = buf_add(LISTBUF)
+        tui.statusline()
+    end
+    bufs[bufidx].view = chanlist.view
+    if begin then buf_switch(bufidx) end
+end
+
 local irchand = {
     ["ACCOUNT"] = function(e)
         assert(irc.server.caps["account-notify"])
@@ -366,6 +620,10 @@ local irchand = {
             prin_irc(0, buf.name, L_AWAY(e), "%s", msg)
         end)
     end,
+    ["BATCH"] = function(e)
+        -- e.batch is only set when a batch ends.
+        if e.batch then batch_commit(e.batch) end
+    end,
     ["MODE"] = function(e)
         if not e.dest then e.dest = e.msg end
         if (e.dest):find("#") then
@@ -432,6 +690,21 @@ local irchand = {
         -- display quit message for all buffers that user has joined,
         -- except the main buffer.
         local userhost = e.user .. "@" .. e.host
+
+        -- if the user quit because of a netsplit, hold the quit back so
+        -- that it can be shown along with everyone else's.
+        local servers = netsplit.servers(e.msg)
+        if servers then
+            local dests = {}
+            buf_with_nick(e.nick, function(i, buf)
+                dests[#dests + 1] = buf.name
+                bufs[i].names[e.nick] = false
+            end)
+            bufs[1].names[e.nick] = false
+            if netsplit_hold(e) then netsplit.quit(servers, e.nick, dests, e) end
+            return
+        end
+
         buf_with_nick(e.nick, function(i, buf)
             prin_irc(0, buf.name, "<--", "%s (%s) quit (%s)",
                 hncol(e.nick), mirc.grey(userhost), e.msg)
@@ -452,6 +725,13 @@ local irchand = {
         -- if we are the ones joining, then switch to that buffer.
         if e.nick == nick then buf_switch(bufidx) end
 
+        -- if the user is returning from a netsplit, hold the join back so
+        -- that it can be shown along with everyone else's.
+        if e.nick ~= nick and netsplit_hold(e)
+        and netsplit.join(e.nick, e.dest, e) then
+            return
+        end
+
         local userhost = e.user .. "@" .. e.host
         prin_irc(0, e.dest, "-->", "%s (%s) joined %s",
             hncol(e.nick), mirc.grey(userhost), hcol(e.dest))
@@ -469,8 +749,12 @@ local irchand = {
                 buf.names[e.nick] = nil; buf.names[e.msg] = true
             end
         end
-        tui.set_colors[e.msg]  = tui.set_colors[e.nick]
-        tui.set_colors[e.nick] = nil
+        local old, new = irc.normalise_nick(e.nick), irc.normalise_nick(e.msg)
+        if old ~= new then
+            tui.set_colors[new] = tui.color_of(old)
+            tui.set_colors[old] = nil
+            statusline.invalidate()
+        end
 
         -- if the user changed the nickname, update the current nick.
         if e.nick == nick then nick = e.msg end
@@ -601,6 +885,33 @@ local irchand = {
         prin_irc(0, buf_cur(), "WHOIS", "[%s] has joined %s", hncol(e.fields[3]), e.msg)
     end,
 
+    -- LIST: RPL_LISTSTART
+    ["321"] = function(_) chanlist_open(true) end,
+
+    -- LIST: RPL_LIST
+    -- <client> <channel> <users> :<topic>
+    --
+    -- there are far too many of these to print; they're collected in
+    -- the channel list and drawn from there. (see chanlist.lua)
+    ["322"] = function(e)
+        -- not every server sends 321 first.
+        if chanlist.done then
+            chanlist_open(true)
+        elseif not buf_idx(LISTBUF) then
+            chanlist_open(false)
+        end
+        chanlist.add(e.fields[3], e.fields[4], e.msg)
+        chanlist_dirty = true
+    end,
+
+    -- LIST: RPL_LISTEND
+    ["323"] = function(_)
+        chanlist.finish()
+        chanlist_dirty = true
+        prin_cmd(MAINBUF, L_NORM(), "Received %d channels. (see %s)",
+            chanlist.count(), LISTBUF)
+    end,
+
     -- URL for channel
     ["328"] = function(e) prin_irc(0, e.dest, "URL", "%s", e.msg) end,
 
@@ -721,6 +1032,28 @@ local irchand = {
         txt = format("%s denizens of %s (%s)", total, hcol(dest), txt)
 
         prin_irc(0, dest, L_NAME(e), "%s", txt)
+
+        local name = bufs[bufidx].name
+        if rejoining and rejoining.left[name] then
+            rejoining.left[name] = nil
+            if not next(rejoining.left) then
+                prin_cmd(MAINBUF, L_NORM(), "Rejoined %d channels in %dms.",
+                    rejoining.count, lurchtime.now() - rejoining.started)
+                rejoining = nil
+            end
+        end
+
+        -- if we were disconnected, ask for what we missed in the meantime.
+        local gap = bufs[bufidx].gap
+        if gap and not gap.requested then
+            if irc.server.caps["draft/chathistory"] then
+                send("CHATHISTORY AFTER %s timestamp=%s %s", dest, gap.since,
+                    config.chathistory_limit)
+                gap.requested = true
+            else
+                bufs[bufidx].gap = nil
+            end
+        end
     end,
 
     -- WHOWAS: RPL_ENDOFWHOWAS
@@ -904,8 +1237,20 @@ CFGHND_CONTINUE = 0
 CFGHND_RETURN   = 1
 
 function parseirc(reply)
+    -- keep track of what the memory allocated while handling the
+    -- message is used for. (see /mem) If a handler fails, the phase
+    -- is reset by rt.on_lerror.
+    lurchmem.phase("parse")
     local event = irc.parse(reply)
-    if not event then return end
+    lurchmem.phase("handlers")
+    if event then handle_ircevent(event) end
+    lurchmem.phase("other")
+end
+
+function handle_ircevent(event)
+    -- if the event is part of an IRCv3 batch, hold on to it until
+    -- the batch ends. (see batch_commit)
+    if irc.batch_stash(event) then return end
 
     last_ircevent = event
 
@@ -984,6 +1329,106 @@ function send_both(fmt, ...)
     end
 end
 
+-- format a logged event (see logs.lua) the same way its handler
+-- would have. Only the events that are logged are handled.
+local function fmt_logged(e)
+    local cmd = e.fields[1]
+    local sender = e.nick or e.from or "?"
+    local userhost = mirc.grey(format("%s@%s", e.user, e.host))
+
+    if cmd == "PRIVMSG" then
+        return config.leftfmt.message(sender, false), e.msg
+    elseif cmd == "CTCPQ_ACTION" then
+        return config.leftfmt.action(e), format("%s %s", hncol(sender), e.msg)
+    elseif cmd == "NOTICE" then
+        return "NOTE", format("<%s> %s", hncol(sender), e.msg)
+    elseif cmd == "JOIN" then
+        return "-->", format("%s (%s) joined %s", hncol(sender), userhost,
+            hcol(e.dest or e.msg))
+    elseif cmd == "PART" then
+        return "<--", format("%s (%s) has left %s (%s)", hncol(sender),
+            userhost, hcol(e.dest), e.msg)
+    elseif cmd == "QUIT" then
+        return "<--", format("%s (%s) quit (%s)", hncol(sender), userhost, e.msg)
+    elseif cmd == "MODE" then
+        return L_NORM(e), format("Mode [%s] by %s",
+            util.join(" ", e.fields, 3) .. " " .. e.msg, hncol(sender))
+    end
+end
+
+-- get the time at which a logged event was sent.
+local function logged_time(e)
+    return assert(lurchtime.at(config.tz, e.tags.time))
+end
+
+-- load the last few lines from a buffer's log into its history, before
+-- the lines that were added since the buffer was opened.
+function buf_backlog(idx)
+    local buf = bufs[idx]
+    local lines = logs.tail(buf.name, config.backlog, buf.backlog)
+    buf.backlog = nil
+
+    local backlog = {}
+
+    for _, line in ipairs(lines) do
+        local e = irc.parse(line)
+        local left, right
+        if e then left, right = fmt_logged(e) end
+        if left then
+            backlog[#backlog + 1] = { logged_time(e), left, right }
+        end
+    end
+
+    buf_insert(idx, 1, backlog)
+end
+
+-- search the logs of a buffer (or of every buffer, if dest is nil),
+-- and put the matches in RESULTBUF.
+--
+-- query is the text to search for, optionally preceded by
+-- "-since YYYY-MM-DD".
+local function search_logs(dest, query)
+    local since = 0
+    local date, rest = query:match("^%-since%s+(%d%d%d%d%-%d%d%-%d%d)%s+(.+)$")
+    if date then
+        since = (lurchtime.parse(date .. "T00:00:00Z") or 0) // 1000
+        query = rest
+    end
+
+    local bufidx = buf_idx_or_add(RESULTBUF)
+    bufs[bufidx].history:clear()
+    bufs[bufidx].scroll = 0
+
+    local dests = logs.dests()
+    if dest then dests = { dest } end
+
+    local hits = 0
+    for _, d in ipairs(dests) do
+        local ret, err = logs.search(d, query, since, function(e)
+            local left, right = fmt_logged(e)
+            if not left then return end
+
+            local time = logged_time(e)
+            buf_append(bufidx, time, hcol(d), format("%s %s %s",
+                mirc.grey(lurchtime.format("%Y-%m-%d", time)), left, right))
+
+            hits = hits + 1
+            if hits >= config.search_limit then return false end
+        end)
+
+        if not ret then
+            prin_cmd(RESULTBUF, L_ERR(), "Couldn't search logs of %s: %s", d, err)
+        end
+        if hits >= config.search_limit then break end
+    end
+
+    local note = ""
+    if hits >= config.search_limit then note = " (limit reached)" end
+    prin_cmd(RESULTBUF, L_NORM(), "%s results for '%s'%s", hits, query, note)
+
+    buf_switch(bufidx); tui.statusline()
+end
+
 local cmdhand = {
     ["/close"] = {
         help = { "Close a buffer. The buffers after the one being closed are shifted left." },
@@ -1022,14 +1467,20 @@ local cmdhand = {
     ["/scroll"] = {
         REQUIRE_ARG = true,
         help = {
-            "Scroll the current buffer.",
+            "Scroll the current buffer by rows on the screen.",
             "Examples:\n" ..
                 "/scroll 0      Scroll to the bottom of the buffer.\n" ..
-                "/scroll +12    Scroll up by 12 lines.\n" ..
-                "/scroll -23    Scroll down by 23 lines.\n"
+                "/scroll +12    Scroll up by 12 rows.\n" ..
+                "/scroll -23    Scroll down by 23 rows.\n" ..
+                "/scroll +page  Scroll up by a screenful (or down, with -page).\n"
         },
         fn = function(a, _, _)
-            if a:match("^%-") and tonumber(a) then
+            local page = tui.text_height() - 1
+            if a == "+page" then
+                buf_scroll(cbuf, page, nil)
+            elseif a == "-page" then
+                buf_scroll(cbuf, -page, nil)
+            elseif a:match("^%-") and tonumber(a) then
                 buf_scroll(cbuf, -(tonumber(a:sub(2, #a))), nil)
             elseif a:match("^%+") and tonumber(a) then
                 buf_scroll(cbuf, tonumber(a:sub(2, #a)), nil)
@@ -1039,10 +1490,80 @@ local cmdhand = {
             redraw()
         end
     },
+    ["/jump"] = {
+        REQUIRE_ARG = true,
+        help = {
+            "Scroll the current buffer to a point in time, or to where you " ..
+            "were when you last left it.",
+            "Examples:\n" ..
+                "/jump read               Jump to the first line you haven't seen.\n" ..
+                "/jump 14:30              Jump to 14:30 today.\n" ..
+                "/jump 2021-06-01         Jump to the start of June 1st, 2021.\n" ..
+                "/jump 2021-06-01 14:30   Jump to 14:30 on June 1st, 2021."
+        },
+        usage = "<read|[YYYY-MM-DD] [HH:MM]>",
+        fn = function(a, args, _)
+            local buf = bufs[cbuf]
+
+            if a == "read" then
+                if not buf.lastread then
+                    prin_cmd(buf_cur(), L_ERR(), "You haven't left %s yet.", buf_cur())
+                    return
+                end
+                buf_scroll_line(cbuf, buf.lastread + 1)
+                redraw()
+                return
+            end
+
+            local date, clock = nil, a
+            if a:match("^%d%d%d%d%-%d%d%-%d%d$") then
+                date = a
+                clock = (args and args ~= "") and args or "00:00"
+            end
+            if not clock:match("^%d%d?:%d%d$") then
+                prin_cmd(buf_cur(), L_ERR(), "Invalid time '%s'.", clock)
+                return
+            end
+            if #clock == 4 then clock = "0" .. clock end
+
+            -- times in the history are in config.tz, and so are those
+            -- that are typed, so neither needs converting.
+            date = date or lurchtime.format("%Y-%m-%d", lurchtime.at(config.tz))
+            local ms = lurchtime.parse(format("%sT%s:00Z", date, clock))
+            if not ms then
+                prin_cmd(buf_cur(), L_ERR(), "Invalid date '%s'.", date)
+                return
+            end
+
+            buf_scroll_line(cbuf, buf.history:search(ms // 1000))
+            redraw()
+        end,
+    },
+    ["/search"] = {
+        REQUIRE_ARG = true,
+        help = {
+            "Search the logs of all buffers for some text. Matches are shown in the " .. RESULTBUF .. " buffer.",
+            "Examples:\n" ..
+                "/search lurch                     Find lines mentioning lurch.\n" ..
+                "/search -since 2021-01-01 lurch   Only look at lines sent in 2021 or later."
+        },
+        usage = "[-since <YYYY-MM-DD>] <text...>",
+        fn = function(_, _, inp)
+            search_logs(nil, inp:match("^%s*[^%s]+%s+(.-)%s*$"))
+        end,
+    },
+    ["/grep"] = {
+        REQUIRE_ARG = true,
+        help = { "Like /search, but only search the logs of the current buffer." },
+        usage = "[-since <YYYY-MM-DD>] <text...>",
+        fn = function(_, _, inp)
+            search_logs(buf_cur(), inp:match("^%s*[^%s]+%s+(.-)%s*$"))
+        end,
+    },
     ["/clear"] = {
         help = { "Clear the current buffer." },
         fn = function(_, _, _)
-            bufs[cbuf].history = {}
+            bufs[cbuf].history:clear()
             bufs[cbuf].scroll = 0
             redraw()
         end
@@ -1103,13 +1624,33 @@ local cmdhand = {
         help = { "Execute a command, and use its output as input for the current buffer." },
         usage = "<command> [args...]",
         fn = function(a, args, _)
-            -- FIXME: ensure this doesn't block on long-running commands
-            local command = format("%s -c '%s %s'",
-                os.getenv("SHELL") or "/bin/sh", a, args)
-            local output = util.capture(command)
-            for line in output:gmatch("([^\n]+)\n?") do
-                parsecmd(line)
-            end
+            -- the output is used as it arrives; the command doesn't
+            -- have to finish first.
+            local command = args and (a .. " " .. args) or a
+            local shell = os.getenv("SHELL") or "/bin/sh"
+            local bufname = buf_cur()
+
+            -- the output goes to the buffer /cmd was run from, even if
+            -- the user has switched away in the meantime. If that buffer
+            -- has been closed, it's only shown in the main buffer.
+            proc.spawn({ shell, "-c", command }, { lines = true }, function(event, data)
+                local bufidx = buf_idx(bufname)
+                local dest = bufidx and bufname or MAINBUF
+
+                if event == "stdout" and data ~= "" then
+                    if bufidx then
+                        buf_with_cur(bufidx, parsecmd, data)
+                    else
+                        prin_cmd(MAINBUF, a, "%s", data)
+                    end
+                elseif event == "stderr" then
+                    prin_cmd(dest, L_ERR(), "%s: %s", a, data)
+                elseif event == "error" then
+                    prin_cmd(dest, L_ERR(), "Couldn't run %s: %s", a, data)
+                elseif event == "exit" and data ~= 0 then
+                    prin_cmd(dest, L_ERR(), "%s exited with status %d", a, data)
+                end
+            end)
         end,
     },
     ["/away"] = {
@@ -1393,6 +1934,48 @@ local cmdhand = {
         end,
     },
     ["/list"] = {
+        help = {
+            "Request the list of channels on the network, and show it in the " ..
+            LISTBUF .. " buffer. The list is sorted by the number of users. " ..
+            "Arguments other than -sort and -filter are passed on to the server.",
+            "Examples:\n" ..
+                "/list                  List all channels.\n" ..
+                "/list -filter linux    Only show channels with 'linux' in their name or topic.\n" ..
+                "/list -filter          Show all channels again.\n" ..
+                "/list -sort name       Sort the channels by name (or users) instead."
+        },
+        usage = "[-sort <users|name>] [-filter [text]] [server arguments]",
+        fn = function(a, args, _)
+            -- sorting and filtering work on the list we already have,
+            -- even if it's still arriving.
+            if a == "-sort" or a == "-filter" then
+                if a == "-sort" then
+                    if args ~= "users" and args ~= "name" then
+                        prin_cmd(buf_cur(), L_ERR(), "Can't sort by '%s'.", args or "")
+                        return
+                    end
+                    chanlist.set_view(args, nil)
+                else
+                    chanlist.set_view(nil, args or "")
+                end
+
+                local bufidx = buf_idx(LISTBUF)
+                if bufidx then
+                    buf_switch(bufidx); tui.statusline()
+                end
+                return
+            end
+
+            if not a then
+                send("LIST")
+            elseif args and args ~= "" then
+                send("LIST %s %s", a, args)
+            else
+                send("LIST %s", a)
+            end
+        end,
+    },
+    ["/commands"] = {
         -- TODO: list user-defined commands.
         help = { "List builtin and user-defined lurch commands." },
         fn = function(_, _, _)
@@ -1433,6 +2016,7 @@ local cmdhand = {
                 bufs = bufs,
 
                 input_buf = tbrl.bufin,
+                input_line = tbrl.text(),
                 input_cursor = tbrl.cursor,
                 input_hist = tbrl.hist,
 
@@ -1450,6 +2034,30 @@ local cmdhand = {
             fp:close()
         end,
     },
+    ["/mem"] = {
+        help = { "Show how much memory lurch is using, and what for." },
+        fn = function(_, _, _)
+            local stats = lurchmem.stats()
+            local phases = { "parse", "handlers", "render", "history", "other" }
+
+            prin_cmd(buf_cur(), L_NORM(), "Lua heap: %d KiB",
+                math.floor(collectgarbage("count")))
+            for _, phase in ipairs(phases) do
+                prin_cmd(buf_cur(), L_NORM(), "  %-8s  %8d KiB in %d blocks", phase,
+                    stats.live[phase] // 1024, stats.count[phase])
+            end
+            prin_cmd(buf_cur(), L_NORM(), "Small blocks: %d KiB allocated, %d KiB free",
+                stats.arena // 1024, stats.pooled // 1024)
+
+            local lines, bytes = 0, 0
+            for _, buf in ipairs(bufs) do
+                lines = lines + #buf.history
+                bytes = bytes + buf.history:bytes()
+            end
+            prin_cmd(buf_cur(), L_NORM(), "History: %d KiB for %d lines",
+                bytes // 1024, lines)
+        end,
+    },
     ["/panic"] = {
         help = { "Summon a Lua panic to aid with debugging." },
         usage = "[errmsg]",
@@ -1543,8 +2151,8 @@ local keyseq_handler = {
     keys = {
         [tb.TB_KEY_CTRL_N] = function(_) parsecmd("/next") end,
         [tb.TB_KEY_CTRL_P] = function(_) parsecmd("/prev") end,
-        [tb.TB_KEY_PGUP]   = function(_) parsecmd("/scroll +3") end,
-        [tb.TB_KEY_PGDN]   = function(_) parsecmd("/scroll -3") end,
+        [tb.TB_KEY_PGUP]   = function(_) parsecmd("/scroll +page") end,
+        [tb.TB_KEY_PGDN]   = function(_) parsecmd("/scroll -page") end,
         [tb.TB_KEY_CTRL_L] = function(_) parsecmd("/redraw") end,
         [tb.TB_KEY_CTRL_C] = function(_) parsecmd("/quit") end,
         [tb.TB_KEY_CTRL_B] = function(_) tbrl.insert_at_curs(mirc.BOLD) end,
@@ -1562,6 +2170,8 @@ local keyseq_handler = {
     }
 }
 
+-- returns true if the key sequence was handled, so that tbrl knows
+-- whether to fall back to its own bindings.
 function rt.on_keyseq(event)
     if event.mod ~= 0 then
         local ev_key = event.ch
@@ -1570,17 +2180,23 @@ function rt.on_keyseq(event)
         if config.keyseqs.mods[event.mod]
         and config.keyseqs.mods[event.mod][ev_key] then
             (config.keyseqs.mods[event.mod][ev_key])(event)
+            return true
         elseif keyseq_handler.mods[event.mod]
         and keyseq_handler.mods[event.mod][ev_key] then
             (keyseq_handler.mods[event.mod][ev_key])(event)
+            return true
         end
     elseif event.key ~= 0 then
         if config.keyseqs.keys[event.key] then
             (config.keyseqs.keys[event.key])(event)
+            return true
         elseif keyseq_handler.keys[event.key] then
             (keyseq_handler.keys[event.key])(event)
+            return true
         end
     end
+
+    return false
 end
 
 function rt.init(args)
@@ -1635,7 +2251,7 @@ function rt.init(args)
     tui.bottom_statusline_func = callbacks.bottom_statusline
 
     tui.refresh()
-    tui.colors = config.colors()
+    tui.set_palette(config.colors())
 
     if tui.tty_width < 40 or tui.tty_height < 8 then
         panic("screen width too small (min 40x8)\n")
@@ -1660,15 +2276,14 @@ function rt.init(args)
     -- used the normal GNU readline, but we now have to implement our
     -- own readline since GNU readline doesn't work in termbox/ncurses.
     -- This means we'll have to implement common features such as
-    -- input history (DONE), completion (TODO), and undo/redo (TODO).
+    -- input history (DONE), completion (TODO), and undo (DONE).
     --
     tbrl.bind_keys(config.keyseqs)
     tbrl.bind_keys(keyseq_handler)
 
-    -- Set the functions to be called when <enter> is pressed, or when
-    -- the screen is resized.
+    -- Set the function to be called when <enter> is pressed. (Resizes
+    -- are handled by rt.on_signal.)
     tbrl.enter_callback = parsecmd
-    tbrl.resize_callback = function() redraw() end
 
     -- Misc stuff
     callbacks.on_startup()
@@ -1684,6 +2299,12 @@ function rt.on_disconnect(_err)
         panic("lurch: link lost: %s\n", _err or "unknown error")
     end
 
+    link_lost = link_lost or lurchtime.now()
+
+    -- batches that were cut off will never end; forget them, lest one
+    -- swallow a later batch with the same reference.
+    irc.batches = {}
+
     -- Wait for an increasing amount of time before reconnecting.
     if (os.time() - reconn_wait) < irc.server.connected then
         return false
@@ -1693,23 +2314,59 @@ function rt.on_disconnect(_err)
     prin_cmd(MAINBUF, L_ERR(),
         "Link lost, attempting reconnection... (%s tries left)", reconn)
 
+    local started = lurchtime.now()
     local ret, err = connect()
     if not ret then
         reconn_wait = math.floor(reconn_wait * 1.6)
         prin_cmd(MAINBUF, L_ERR(), "Unable to connect (%s), waiting %s seconds",
             err, reconn_wait)
-    else
-        -- rejoin channels.
-        -- FIXME: this will join channels that have been left, too
-        for i = 2, #bufs do
+        return ret, err
+    end
+
+    prin_cmd(MAINBUF, L_NORM(), "Reconnected in %dms%s (%dms since link lost).",
+        lurchtime.now() - started,
+        lurchconn.resumed() and ", resuming the TLS session" or "",
+        lurchtime.now() - link_lost)
+
+    -- rejoin channels, as many at a time as will fit on a line.
+    -- FIXME: this will join channels that have been left, too
+    local chans = {}
+    for i = 2, #bufs do
+        local name = bufs[i].name
+        if name:find("^[#&]") then
             -- clear the names list of the channels. it will
             -- be refreshed when the server sends 353.
             bufs[i].names = {}
             bufs[i].access = {}
 
-            send(":%s JOIN :%s", nick, bufs[i].name)
+            -- remember where we were disconnected, so that we can fill
+            -- the gap with the history we missed once we've rejoined.
+            -- (see the 366 handler)
+            bufs[i].gap = {
+                since = bufs[i].lastseen or lurchtime.iso(),
+                pos = #bufs[i].history + 1,
+            }
+
+            chans[#chans + 1] = name
+        end
+    end
+
+    rejoining = { started = lurchtime.now(), left = {}, count = #chans }
+    for _, chan in ipairs(chans) do rejoining.left[chan] = true end
+    if #chans == 0 then rejoining = nil end
+    link_lost = nil
+
+    -- 512 bytes, minus "JOIN ", the CRLF and some room for the prefix
+    -- that the server adds when relaying the line.
+    local line = ""
+    for _, chan in ipairs(chans) do
+        if #line > 0 and (#line + 1 + #chan) > 400 then
+            send("JOIN %s", line)
+            line = ""
         end
+        line = #line > 0 and (line .. "," .. chan) or chan
     end
+    if #line > 0 then send("JOIN %s", line) end
 
     return ret, err
 end
@@ -1725,7 +2382,8 @@ local sighand = {
     [10] = function() end,
     -- SIGUSR2
     [12] = function() end,
-    -- SIGWINCH
+    -- SIGWINCH (sent at most once a frame, however many times the
+    -- terminal was resized; termbox's resize events are folded into it)
     [28] = function() redraw() end,
     -- catch-all
     [0] = function() return true end,
@@ -1744,6 +2402,10 @@ function rt.on_signal(sig)
 end
 
 function rt.on_lerror(err)
+    -- whatever was being done when the error happened didn't get the
+    -- chance to switch the phase back. (see parseirc)
+    lurchmem.phase("other")
+
     local bt = debug.traceback(err, 2)
     xpcall(function()
         bt = bt:gsub("\t", "    ")
@@ -1754,6 +2416,24 @@ function rt.on_lerror(err)
     end)
 end
 
+-- called regularly (at least once a second) from the main loop.
+function rt.on_tick()
+    if netsplit.pending() then netsplit_flush() end
+    proc.tick()
+
+    -- the channel list is redrawn at most once a tick while it's
+    -- arriving, not for each channel.
+    if chanlist_dirty then
+        chanlist_dirty = false
+        local cb = bufs[cbuf]
+        if cb.name == LISTBUF and cb.scroll == 0 then redraw() end
+    end
+end
+
+function rt.on_proc(pid, event, data)
+    proc.on_event(pid, event, data)
+end
+
 function rt.on_reply(reply)
     if os.getenv("LURCH_DEBUG") then
         util.append(DBGFILE, format("%s >r> %s\n", os.time(), reply))
@@ -1766,7 +2446,7 @@ end
 -- write the input buffer.
 function rt.on_input(event)
     tbrl.on_event(event)
-    tui.prompt(tbrl.bufin[tbrl.hist], tbrl.cursor)
+    tui.prompt(tbrl.text(), tbrl.cursor)
 end
 
 function rt.on_complete(text, from, to)
@@ -1,5 +1,7 @@
 local format = string.format
 local irc = require("irc")
+local lurchlog = require("lurchlog")
+local lurchtime = require("lurchtime")
 local mirc = require("mirc")
 local util = require("util")
 
@@ -21,16 +23,64 @@ function M.setup(server)
     os.execute("mkdir -p " .. M.logdir)
 end
 
-function M.append(dest, event)
+function M.path(dest)
     assert(M.logdir)
-    local logfile = format("%s/%s.txt", M.logdir, dest)
+    return format("%s/%s.txt", M.logdir, dest)
+end
 
+local function logline(event)
     if not event.tags.time then
-        event.tags.time = os.date("!%Y-%m-%dT%H:%M:%S.000Z")
+        event.tags.time = lurchtime.iso()
     end
 
     event.msg = mirc.remove_nonstandard(event.msg)
-    util.append(logfile, irc.construct(event) .. "\n")
+    return irc.construct(event) .. "\n"
+end
+
+function M.append(dest, event)
+    util.append(M.path(dest), logline(event))
+end
+
+-- append several events to a buffer's log with a single write.
+function M.append_many(dest, events)
+    local lines = {}
+    for i, event in ipairs(events) do
+        lines[i] = logline(event)
+    end
+    util.append(M.path(dest), table.concat(lines))
+end
+
+-- get the size of a buffer's log, or nil if there isn't one.
+function M.size(dest)
+    return lurchlog.size(M.path(dest))
+end
+
+-- get the last n lines from a buffer's log, ignoring anything past the
+-- first <limit> bytes if limit is given. The log is mapped into memory
+-- and read backwards from the end, so this is cheap even for huge logs.
+function M.tail(dest, n, limit)
+    return lurchlog.tail(M.path(dest), n, limit) or {}
+end
+
+-- list the buffers that have logs.
+function M.dests()
+    assert(M.logdir)
+    return lurchlog.list(M.logdir) or {}
+end
+
+-- search a buffer's logs for lines that contain text (ignoring case),
+-- and that were sent after since (if since isn't 0). fn is called with
+-- the parsed event for each match, and can return false to stop the
+-- search.
+--
+-- The search is done using a sidecar index that's kept next to each
+-- log, so that only the parts of the log that could match have to
+-- be read. (See logidx.c)
+function M.search(dest, text, since, fn)
+    return lurchlog.search(M.path(dest), text, since, function(line)
+        local event = irc.parse(line)
+        if event then return fn(event) end
+    end)
 end
 
 return M
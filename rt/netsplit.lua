@@ -0,0 +1,131 @@
+-- Netsplit and netjoin detection. When a server splits from the network,
+-- everyone connected to it quits at once with a message naming the two
+-- servers involved ("irc.a.net irc.b.net"), and joins everything again
+-- when the servers reconnect. Instead of printing a line for each user
+-- in each buffer, those quits and joins are collected here and then
+-- shown as a single line per buffer. (see the QUIT and JOIN handlers
+-- and rt.on_tick in init.lua)
+
+local M = {}
+
+-- how long to wait after the last quit (or join) of a split (or join),
+-- in seconds, before it's considered to be over.
+M.window = 2
+
+-- how long to remember the users that split, in seconds, so that their
+-- return can be recognised as a netjoin.
+M.memory = 60 * 60
+
+-- returns the current time. (replaced in the tests.)
+M.clock = os.time
+
+M.groups = {}   -- splits and joins that are still collecting users
+M.split  = {}   -- users that split, and when: nick -> { servers, time }
+
+-- check if a quit message is that of a netsplit, and if so, return the
+-- two servers involved.
+function M.servers(msg)
+    local a, b = msg:match("^([%w%-%.%*]+) ([%w%-%.%*]+)$")
+    if not a then return nil end
+
+    for _, server in ipairs({ a, b }) do
+        if not server:find(".", 1, true) or server:find("..", 1, true)
+        or server:sub(1, 1) == "." or server:sub(-1) == "." then
+            return nil
+        end
+    end
+
+    return a .. " " .. b
+end
+
+local function group(kind, servers, now)
+    local key = kind .. " " .. servers
+    local g = M.groups[key]
+    if not g then
+        g = { kind = kind, servers = servers, start = now,
+            dests = {}, order = {} }
+        M.groups[key] = g
+    end
+    g.last = now
+    return g
+end
+
+local function add(g, dest, nick, event)
+    local d = g.dests[dest]
+    if not d then
+        d = { nicks = {}, events = {} }
+        g.dests[dest] = d
+        g.order[#g.order + 1] = dest
+    end
+    d.nicks[#d.nicks + 1] = nick
+    d.events[#d.events + 1] = event
+end
+
+-- record that nick quit because of a split between servers, and was in
+-- the buffers dests at that time.
+function M.quit(servers, nick, dests, event)
+    local now = M.clock()
+    local g = group("split", servers, now)
+    for _, dest in ipairs(dests) do add(g, dest, nick, event) end
+    M.split[nick] = { servers = servers, time = now }
+end
+
+-- record that nick joined dest. Returns true if the join is part of a
+-- netjoin (i.e. nick recently split), false otherwise.
+function M.join(nick, dest, event)
+    local now = M.clock()
+    local s = M.split[nick]
+
+    if not s then return false end
+    if (now - s.time) > M.memory then
+        M.split[nick] = nil
+        return false
+    end
+
+    add(group("join", s.servers, now), dest, nick, event)
+    return true
+end
+
+-- return the splits and joins that are over (i.e. that haven't had any
+-- users added for M.window seconds), oldest first, and stop tracking them.
+--
+-- Each has the fields kind ("split" or "join"), servers, start, order
+-- (the buffers affected, in order), and dests, which maps each of those
+-- buffers to the nicks that split or joined there and the events that
+-- were held.
+function M.finished()
+    local now = M.clock()
+    local done = {}
+
+    for key, g in pairs(M.groups) do
+        if (now - g.last) >= M.window then
+            done[#done + 1] = g
+            M.groups[key] = nil
+        end
+    end
+    if #done == 0 then return done end
+
+    table.sort(done, function(a, b) return a.start < b.start end)
+
+    -- users that have returned don't need to be remembered anymore, and
+    -- neither do those that split too long ago.
+    for _, g in ipairs(done) do
+        if g.kind == "join" then
+            for _, d in pairs(g.dests) do
+                for _, nick in ipairs(d.nicks) do M.split[nick] = nil end
+            end
+        end
+    end
+    for nick, s in pairs(M.split) do
+        if (now - s.time) > M.memory then M.split[nick] = nil end
+    end
+
+    return done
+end
+
+-- whether there are any splits or joins that aren't over yet.
+function M.pending()
+    return next(M.groups) ~= nil
+end
+
+return M
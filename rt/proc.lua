@@ -0,0 +1,131 @@
+-- Child processes that run alongside the UI, rather than blocking it
+-- like io.popen and os.execute do. (see proc.c)
+--
+--    proc.spawn({ "notify-send", "lurch", "You were pinged" })
+--
+--    proc.spawn({ "fortune" }, { lines = true }, function(event, data)
+--        if event == "stdout" then prin_cmd(buf_cur(), "fortune", "%s", data) end
+--    end)
+--
+-- The callback is called with:
+--    "stdout", data    output from the command, as it arrives (or a line at
+--    "stderr", data    a time, if opts.lines is set).
+--    "exit", code      once the command has exited and all of its output
+--                      has been passed on. code is its exit status, or 128
+--                      plus the signal that killed it.
+--    "timeout"         when the command is killed for taking too long. The
+--                      "exit" follows.
+--    "error", msg      if the command couldn't be started. Nothing follows.
+--
+-- opts can contain:
+--    input             a string to write to the command's stdin.
+--    timeout           seconds after which the command is killed.
+--    lines             whether to split stdout and stderr into lines.
+
+local lurchproc = require('lurchproc')
+
+local M = {}
+
+-- how many commands may run at once; the rest wait their turn.
+M.max = 4
+
+-- returns the current time. (replaced in the tests.)
+M.clock = os.time
+
+M.running = {}  -- pid -> job
+M.queue   = {}  -- jobs waiting for a free slot, oldest first
+
+local function call(job, ...)
+    if job.callback then (job.callback)(...) end
+end
+
+local function count()
+    local n = 0
+    for _ in pairs(M.running) do n = n + 1 end
+    return n
+end
+
+local function start(job)
+    local pid, err = lurchproc.spawn(job.argv, job.opts.input)
+    if not pid then
+        call(job, "error", err)
+        return
+    end
+
+    job.pid = pid
+    job.buf = { stdout = "", stderr = "" }
+    if job.opts.timeout then
+        job.deadline = M.clock() + job.opts.timeout
+    end
+    M.running[pid] = job
+end
+
+-- start as many of the waiting commands as there's room for.
+local function dequeue()
+    while #M.queue > 0 and count() < M.max do
+        start(table.remove(M.queue, 1))
+    end
+end
+
+function M.spawn(argv, opts, callback)
+    local job = { argv = argv, opts = opts or {}, callback = callback }
+    M.queue[#M.queue + 1] = job
+    dequeue()
+    return job
+end
+
+-- kill a command (or take it off the queue, if it hasn't started yet).
+function M.kill(job, sig)
+    if job.pid then
+        return lurchproc.kill(job.pid, sig)
+    end
+
+    for i, j in ipairs(M.queue) do
+        if j == job then
+            table.remove(M.queue, i)
+            break
+        end
+    end
+    return true
+end
+
+-- called by rt.on_proc with what the C side has to say about a command.
+function M.on_event(pid, event, data)
+    local job = M.running[pid]
+    if not job then return end
+
+    if event == "exit" then
+        -- pass on whatever's left of an unfinished last line.
+        for _, stream in ipairs({ "stdout", "stderr" }) do
+            if job.buf[stream] ~= "" then call(job, stream, job.buf[stream]) end
+        end
+
+        M.running[pid] = nil
+        call(job, "exit", data)
+        dequeue()
+    elseif not job.opts.lines then
+        call(job, event, data)
+    else
+        local buf = job.buf[event] .. data
+        local last = 1
+        for line, nxt in buf:gmatch("([^\n]*)\n()") do
+            call(job, event, line)
+            last = nxt
+        end
+        job.buf[event] = buf:sub(last)
+    end
+end
+
+-- kill the commands that have run for too long. (see rt.on_tick)
+function M.tick()
+    local now = M.clock()
+    for pid, job in pairs(M.running) do
+        if job.deadline and now >= job.deadline and not job.timed_out then
+            job.timed_out = true
+            call(job, "timeout")
+            lurchproc.kill(pid)
+        end
+    end
+end
+
+return M
@@ -0,0 +1,68 @@
+-- A model of the statusline, which keeps the text rendered for each
+-- buffer so that only the buffers whose state has changed (unread
+-- messages, pings, whether they're the current buffer) have to be
+-- rendered again when the statusline is redrawn.
+--
+-- See callbacks.fancy_statusline for an example of its use.
+
+local M = {}
+
+-- what each render function has rendered: its segments, by buffer
+-- (weak, so that closed buffers are forgotten), and the line that they
+-- made up. Kept apart, so that statuslines rendered by different
+-- functions don't get each other's text.
+M.cache = setmetatable({}, { __mode = "k" })
+
+local function cache_of(render_fn)
+    local c = M.cache[render_fn]
+    if not c then
+        c = { segments = setmetatable({}, { __mode = "k" }), line = nil, count = 0 }
+        M.cache[render_fn] = c
+    end
+    return c
+end
+
+-- render the statusline for the buffers bufs, cbuf being the current
+-- one. render_fn(idx, buf, current) is called to get the text of a
+-- buffer's segment when it's changed; it can return nil to leave the
+-- buffer out.
+function M.render(bufs, cbuf, render_fn)
+    local c = cache_of(render_fn)
+    local parts = {}
+    local changed = false
+
+    for i, buf in ipairs(bufs) do
+        local current = i == cbuf
+        local seg = c.segments[buf]
+
+        if not seg or seg.idx ~= i or seg.current ~= current
+        or seg.name ~= buf.name or seg.pings ~= buf.pings
+        or seg.unreadh ~= buf.unreadh or seg.unreadl ~= buf.unreadl then
+            seg = {
+                idx = i, current = current, name = buf.name,
+                pings = buf.pings, unreadh = buf.unreadh, unreadl = buf.unreadl,
+                text = render_fn(i, buf, current) or "",
+            }
+            c.segments[buf] = seg
+            changed = true
+        end
+
+        parts[#parts + 1] = seg.text
+    end
+
+    -- a buffer might have been closed.
+    if changed or not c.line or #parts ~= c.count then
+        c.line = table.concat(parts)
+        c.count = #parts
+    end
+
+    return c.line
+end
+
+-- forget all rendered segments (e.g. after changing the colours they
+-- were rendered with).
+function M.invalidate()
+    M.cache = setmetatable({}, { __mode = "k" })
+end
+
+return M
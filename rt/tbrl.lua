@@ -1,62 +1,54 @@
 -- tbrl: readline for termbox.
+--
+-- The line being edited is kept in a lurchedit editor (see edit.c), so
+-- editing it doesn't mean rebuilding the whole line on every keypress.
 
 local tb = require('tb')
-local utf8utils = require('utf8utils')
-local inspect = require('inspect')
+local lurchedit = require('lurchedit')
 local M = {}
 
-M.bufin = { "" }
+M.bufin = { "" }           -- input history (the current line is in M.line)
 M.hist = #M.bufin
-M.cursor = 0
+M.line = lurchedit.new()
+M.cursor = 0               -- the cursor's column on the screen
 
 M.enter_callback = nil
 M.resize_callback = nil
 
-local _ulen = function(s)
-    return assert(utf8.len(s))
-end
-local _usub = function(s, i, j)
-    i = utf8.offset(s, i)
-    j = utf8.offset(s, j + 1) - 1
-    return string.sub(s, i, j)
+-- the line being edited.
+function M.text()
+    return M.line:text()
 end
 
 function M.insert_at_curs(text)
     if not text then return end
-    M.bufin[M.hist] = utf8utils.insert(M.bufin[M.hist], M.cursor, text)
-    M.cursor = M.cursor + 1
+    M.line:insert(text)
+    M.cursor = M.line:column()
 end
 
-local function _backspace()
-    if M.cursor == 0 then return end
-    M.bufin[M.hist] = _usub(M.bufin[M.hist], 1, M.cursor-1) ..
-        _usub(M.bufin[M.hist], M.cursor+1, _ulen(M.bufin[M.hist]))
-    M.cursor = M.cursor - 1
+-- switch to another entry in the history, keeping any changes made
+-- to the current one.
+local function _goto_hist(idx)
+    M.bufin[M.hist] = M.line:text()
+    M.hist = idx
+    M.line:set(M.bufin[M.hist])
 end
 
-local function _home() M.cursor = 0 end
-local function _end() M.cursor = _ulen(M.bufin[M.hist]) end
-local function _right()
-    if M.cursor < _ulen(M.bufin[M.hist]) then M.cursor = M.cursor + 1 end
-end
-local function _left() if M.cursor > 0 then M.cursor = M.cursor - 1 end end
+local function _backspace() M.line:delete(-1) end
+local function _delete() M.line:delete(1) end
+local function _home() M.line:move(-M.line:cursor()) end
+local function _end() M.line:move(M.line:len() - M.line:cursor()) end
+local function _right() M.line:move(1) end
+local function _left() M.line:move(-1) end
+local function _word_left() M.line:move(M.line:word(-1)) end
+local function _word_right() M.line:move(M.line:word(1)) end
 local function _up()
-    if M.hist > 1 then
-        M.hist = M.hist - 1
-        M.cursor = _ulen(M.bufin[M.hist])
-    end
+    if M.hist > 1 then _goto_hist(M.hist - 1) end
 end
 local function _down()
-    if M.hist < #M.bufin then
-        M.hist = M.hist + 1
-        M.cursor = _ulen(M.bufin[M.hist])
-    end
+    if M.hist < #M.bufin then _goto_hist(M.hist + 1) end
 end
 
--- TODO: Ctrl-_ undo
--- TODO: Ctrl-d delete at right of cursor
--- TODO:  Esc-d delete word at right of cursor
--- TODO:  Esc-h delete word at left of cursor
 M.bindings = {
     keys = {
         -- backspace
@@ -64,10 +56,7 @@ M.bindings = {
         [tb.TB_KEY_BACKSPACE2] = _backspace,
 
         -- delete
-        [tb.TB_KEY_DELETE] = function(_)
-            M.bufin[M.hist] = _usub(M.bufin[M.hist], 1, M.cursor) ..
-                _usub(M.bufin[M.hist], M.cursor+2, _ulen(M.bufin[M.hist]))
-        end,
+        [tb.TB_KEY_DELETE] = _delete,     [tb.TB_KEY_CTRL_D] = _delete,
 
         -- cursor movement, history movement
         [tb.TB_KEY_HOME]        = _home,  [tb.TB_KEY_CTRL_A] = _home,
@@ -79,36 +68,26 @@ M.bindings = {
 
         -- delete from cursor until end of line
         [tb.TB_KEY_CTRL_K] = function(_)
-            M.bufin[M.hist] = _usub(M.bufin[M.hist], 1, M.cursor)
+            M.line:kill(M.line:len() - M.line:cursor())
         end,
 
         -- delete word to the left of cursor.
-        [tb.TB_KEY_CTRL_W] = function(_)
-            -- if the cursor is on a space, move left until we
-            -- encounter a non-whitespace character.
-            if _usub(M.bufin[M.hist], M.cursor, M.cursor) == " " then
-                while _usub(M.bufin[M.hist], M.cursor, M.cursor) == " " do
-                    if M.cursor <= 0 then break end
-                    M.cursor = M.cursor - 1
-                end
-            end
+        [tb.TB_KEY_CTRL_W] = function(_) M.line:kill(M.line:word(-1)) end,
 
-            -- now that we're on a solid character, move left until
-            -- we encounter another space.
-            while _usub(M.bufin[M.hist], M.cursor, M.cursor) ~= " " do
-                if M.cursor <= 0 then break end
-                M.cursor = M.cursor - 1
-            end
+        -- paste whatever was last deleted with Ctrl-K, Ctrl-W, or Alt-d.
+        [tb.TB_KEY_CTRL_Y] = function(_) M.line:yank() end,
 
-            -- delete whatever is after our cursor.
-            M.bufin[M.hist] = _usub(M.bufin[M.hist], 1, M.cursor)
-        end,
+        -- undo
+        [tb.TB_KEY_CTRL_UNDERSCORE] = function(_) M.line:undo() end,
 
         -- space, enter
         [tb.TB_KEY_SPACE] = function(_) M.insert_at_curs(" ") end,
         [tb.TB_KEY_ENTER] = function(_)
+            local line = M.line:text()
+            M.bufin[M.hist] = line
+
             if M.enter_callback then
-                M.enter_callback(M.bufin[M.hist])
+                M.enter_callback(line)
             end
 
             -- if the user scrolled up in history and re-entered
@@ -117,24 +96,36 @@ M.bindings = {
                 -- if the current entry is empty, overwrite it
                 local idx = #M.bufin
                 if M.bufin[idx] ~= "" then idx = #M.bufin + 1 end
-                M.bufin[idx] = M.bufin[M.hist]
+                M.bufin[idx] = line
             end
 
             M.bufin[#M.bufin + 1] = ""; M.hist = #M.bufin
-            M.cursor = 0
+            M.line:set("")
         end
     },
 
     mods = {
+        [tb.TB_MOD_ALT] = {
+            [98]  = _word_left,  -- Alt+b
+            [102] = _word_right, -- Alt+f
+
+            -- Alt+d: delete word to the right of cursor.
+            [100] = function(_) M.line:kill(M.line:word(1)) end,
+        }
     }
 }
 
+-- key combos with modifiers that are handled elsewhere (see bind_keys).
+-- these are given a chance to handle a key combo before M.bindings.mods,
+-- and should return true if they did.
+M.hooks = {}
+
 function M.bind_keys(keystruct)
     for key, _ in pairs(keystruct.keys) do
         M.bindings.keys[key] = rt.on_keyseq
     end
     for key, _ in pairs(keystruct.mods) do
-        M.bindings.mods[key] = rt.on_keyseq
+        M.hooks[key] = rt.on_keyseq
     end
 end
 
@@ -143,16 +134,22 @@ function M.on_event(event)
     or event.type == tb.TB_EVENT_MOUSE then
         -- The key event could be a key combo or a char.
         if event.ch ~= 0 and event.mod == 0 then
-            M.insert_at_curs(utf8.char(event.ch))
+            M.line:insert(utf8.char(event.ch))
         elseif event.ch ~= 0 and event.mod ~= 0 then
-            if M.bindings.mods[event.mod] then
-                (M.bindings.mods[event.mod])(event)
+            local hook = M.hooks[event.mod]
+            if not (hook and hook(event)) then
+                local binds = M.bindings.mods[event.mod]
+                if binds and binds[event.ch] then
+                    (binds[event.ch])(event)
+                end
             end
         elseif event.key ~= 0 then
             if M.bindings.keys[event.key] then
                 (M.bindings.keys[event.key])(event)
             end
         end
+
+        M.cursor = M.line:column()
     elseif event.type == tb.TB_EVENT_RESIZE then
         if M.resize_callback then
             M.resize_callback()
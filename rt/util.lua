@@ -19,6 +19,9 @@ function util.last_gmatch(s, pat)
     return last
 end
 
+-- run a shell command and return its output. This blocks until the
+-- command exits; use proc.spawn for commands that should run while
+-- lurch does. (see proc.lua)
 function util.capture(cmd)
     local cmd = io.popen(cmd, 'r')
     if not cmd then return nil end
@@ -0,0 +1,178 @@
+/*
+ * timestamps: parsing IRCv3 server-time tags, and formatting the times
+ * shown next to each line.
+ *
+ * the times that the Lua side passes around for display are "shifted"
+ * epochs: seconds since the epoch, plus the offset of the timezone the
+ * user configured (config.tz). formatting them with gmtime(3) therefore
+ * gives the time in that timezone, regardless of the system's timezone.
+ *
+ * formatting is cached for each format string and second, since lines
+ * tend to arrive in bursts within the same second.
+ */
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "srvtime.h"
+
+#define FMTCACHE_SIZE 4
+
+struct fmtcache {
+	char    fmt[64];
+	int64_t secs;
+	char    out[128];
+};
+
+static struct fmtcache fmtcache[FMTCACHE_SIZE];
+static size_t fmtcache_next = 0;
+
+static _Bool
+digits(const char *s, size_t n, unsigned *out)
+{
+	*out = 0;
+	for (size_t i = 0; i < n; ++i) {
+		if (!isdigit(s[i]))
+			return false;
+		*out = *out * 10 + (unsigned) (s[i] - '0');
+	}
+	return true;
+}
+
+/* see http://howardhinnant.github.io/date_algorithms.html */
+static int64_t
+days_from_civil(int64_t y, unsigned m, unsigned d)
+{
+	y -= m <= 2;
+	int64_t  era = (y >= 0 ? y : y - 399) / 400;
+	unsigned yoe = (unsigned) (y - era * 400);
+	unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (int64_t) doe - 719468;
+}
+
+/*
+ * parse a time of the form YYYY-MM-DDThh:mm:ss[.sss]Z (see ISO
+ * 8601:2004(E) 4.3.2) into milliseconds since the epoch. returns -1 if
+ * the time is invalid.
+ */
+int64_t
+srvtime_parse(const char *s, size_t len)
+{
+	unsigned Y, M, D, h, m, sec;
+
+	if (len < 19 || s[4] != '-' || s[7] != '-' || s[10] != 'T'
+			|| s[13] != ':' || s[16] != ':')
+		return -1;
+	if (!digits(&s[0], 4, &Y) || !digits(&s[5], 2, &M)
+			|| !digits(&s[8], 2, &D) || !digits(&s[11], 2, &h)
+			|| !digits(&s[14], 2, &m) || !digits(&s[17], 2, &sec))
+		return -1;
+	if (M < 1 || M > 12 || D < 1 || D > 31 || h > 23 || m > 59 || sec > 60)
+		return -1;
+
+	int64_t ms = 0;
+	if (len > 20 && s[19] == '.') {
+		unsigned scale = 100;
+		for (size_t i = 20; i < len && isdigit(s[i]); ++i, scale /= 10)
+			ms += (s[i] - '0') * scale;
+	}
+
+	int64_t secs = days_from_civil(Y, M, D) * 86400 + h * 3600 + m * 60 + sec;
+	return secs * 1000 + ms;
+}
+
+/* milliseconds since the epoch. */
+int64_t
+srvtime_now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/*
+ * parse a timezone of the form UTC[+-]hh:mm into an offset in seconds.
+ * the last timezone parsed is remembered, as it's almost always the
+ * same one (config.tz).
+ */
+_Bool
+srvtime_offset(const char *tz, int64_t *out)
+{
+	static char last[32] = "";
+	static int64_t last_offset = 0;
+
+	if (last[0] && !strcmp(tz, last)) {
+		*out = last_offset;
+		return true;
+	}
+
+	char sign = 0;
+	unsigned h = 0, m = 0;
+	int end = 0;
+	if (sscanf(tz, "UTC%c%u:%u%n", &sign, &h, &m, &end) != 3
+			|| tz[end] != '\0' || (sign != '+' && sign != '-'))
+		return false;
+
+	*out = (int64_t) h * 3600 + (int64_t) m * 60;
+	if (sign == '-') *out = -*out;
+
+	if (strlen(tz) < sizeof(last)) {
+		strcpy(last, tz);
+		last_offset = *out;
+	}
+	return true;
+}
+
+/* format a (shifted) time with strftime(3). */
+const char *
+srvtime_format(const char *fmt, int64_t secs)
+{
+	static char uncached[128];
+
+	size_t fmtlen = strlen(fmt);
+	struct fmtcache *c = NULL;
+
+	if (fmtlen < sizeof(fmtcache[0].fmt)) {
+		for (size_t i = 0; i < FMTCACHE_SIZE; ++i) {
+			if (fmtcache[i].secs == secs && !strcmp(fmtcache[i].fmt, fmt))
+				return fmtcache[i].out;
+		}
+
+		c = &fmtcache[fmtcache_next];
+		fmtcache_next = (fmtcache_next + 1) % FMTCACHE_SIZE;
+	}
+
+	char *out = c ? c->out : uncached;
+	size_t outsz = c ? sizeof(c->out) : sizeof(uncached);
+
+	time_t t = (time_t) secs;
+	struct tm tm;
+	gmtime_r(&t, &tm);
+	if (strftime(out, outsz, fmt, &tm) == 0)
+		out[0] = '\0';
+
+	if (c) {
+		memcpy(c->fmt, fmt, fmtlen + 1);
+		c->secs = secs;
+	}
+	return out;
+}
+
+/* format a time (in milliseconds) as a server-time tag. */
+void
+srvtime_iso(int64_t ms, char *buf, size_t sz)
+{
+	time_t t = (time_t) (ms / 1000);
+	struct tm tm;
+	gmtime_r(&t, &tm);
+
+	char date[32];
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &tm);
+	snprintf(buf, sz, "%s.%03dZ", date, (int) (ms % 1000));
+}
@@ -0,0 +1,13 @@
+#ifndef SRVTIME_H
+#define SRVTIME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+int64_t     srvtime_parse(const char *s, size_t len);
+int64_t     srvtime_now(void);
+_Bool       srvtime_offset(const char *tz, int64_t *out);
+const char *srvtime_format(const char *fmt, int64_t secs);
+void        srvtime_iso(int64_t ms, char *buf, size_t sz);
+
+#endif
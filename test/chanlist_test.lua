@@ -0,0 +1,82 @@
+local lunatest  = package.loaded.lunatest
+local assert_eq = lunatest.assert_equal
+local assert_ye = lunatest.assert_true
+local assert_no = lunatest.assert_false
+
+local chanlist = require('chanlist')
+local M = {}
+
+local function names()
+    local out = {}
+    for r = 1, chanlist.rows() do
+        out[#out + 1] = (chanlist.row(r))
+    end
+    return table.concat(out, " ")
+end
+
+function M.setup()
+    chanlist.begin()
+    chanlist.set_view("users", "")
+end
+
+function M.test_sort()
+    chanlist.add("#b", "10", "bees")
+    chanlist.add("#a", "30", "ants")
+    chanlist.add("#c", "10", "cats")
+    assert_eq(chanlist.rows(), 3)
+    assert_eq(names(), "#a #b #c")
+
+    -- channels that arrive later are merged into the sorted list.
+    chanlist.add("#d", "20", "dogs")
+    chanlist.add("#e", "40", "eels")
+    assert_eq(names(), "#e #a #d #b #c")
+
+    chanlist.set_view("name", nil)
+    assert_eq(names(), "#a #b #c #d #e")
+    chanlist.add("#0", "1", "")
+    assert_eq(names(), "#0 #a #b #c #d #e")
+end
+
+function M.test_filter()
+    chanlist.add("#lurch", "5", "an IRC client")
+    chanlist.add("#lua", "50", "The Lua language")
+    chanlist.add("#c", "20", "The C language")
+
+    chanlist.set_view(nil, "LANGUAGE")
+    assert_eq(names(), "#lua #c")
+
+    -- the filter applies to channels that arrive afterwards, too.
+    chanlist.add("#fennel", "30", "a language for Lua")
+    chanlist.add("#irc", "100", "")
+    assert_eq(names(), "#lua #fennel #c")
+
+    chanlist.set_view(nil, "")
+    assert_eq(chanlist.rows(), 5)
+    assert_eq(chanlist.count(), 5)
+end
+
+function M.test_view()
+    chanlist.add("#a", "1", "ants")
+    chanlist.add("#b", "2", "bees")
+
+    -- the view is upside down, so that the first row is at the bottom.
+    local view = chanlist.view
+    assert_eq(#view, 2)
+    assert_eq(view[2][1], "2")
+    assert_eq(view[2][2], "#b")
+    assert_eq(view[2][3], "bees")
+    assert_eq(view[1][2], "#a")
+    assert_eq(view[3], nil)
+end
+
+function M.test_begin()
+    chanlist.add("#a", "1", "")
+    chanlist.finish()
+    assert_ye(chanlist.done)
+
+    chanlist.begin()
+    assert_no(chanlist.done)
+    assert_eq(chanlist.rows(), 0)
+end
+
+return M
@@ -19,6 +19,58 @@ function M.test_tags_value()
     assert_true(e.tags.batch); assert_equal(e.tags.batch, "1")
 end
 
+function M.test_batch()
+    irc.handle(irc.parse(":irc.host BATCH +yXNAbvnRHTRBv netsplit irc.hub other.host"))
+    local batch = irc.batches["yXNAbvnRHTRBv"]
+    assert_true(batch)
+    assert_equal(batch.type, "netsplit")
+    _assert_table_eq(batch.params, { "irc.hub", "other.host" })
+
+    local e = irc.parse("@batch=yXNAbvnRHTRBv :aviating!u@h QUIT :irc.hub other.host")
+    assert_true(irc.batch_stash(e))
+    assert_false(irc.batch_stash(irc.parse(":aviating!u@h QUIT :Quit: bye")))
+
+    local done = irc.parse(":irc.host BATCH -yXNAbvnRHTRBv")
+    irc.handle(done)
+    assert_equal(done.batch, batch)
+    assert_equal(#done.batch.events, 1)
+    assert_equal(irc.batches["yXNAbvnRHTRBv"], nil)
+end
+
+function M.test_nested_batch()
+    irc.handle(irc.parse(":irc.host BATCH +outer chathistory #chan"))
+    local outer = irc.batches["outer"]
+    local e1 = irc.parse("@batch=outer :a!u@h PRIVMSG #chan :one")
+    assert_true(irc.batch_stash(e1))
+
+    local start = irc.parse("@batch=outer :irc.host BATCH +inner netsplit a.hub b.hub")
+    assert_true(irc.batch_stash(start))
+    local inner = irc.batches["inner"]
+    assert_true(inner)
+    assert_equal(inner.type, "netsplit")
+
+    local e2 = irc.parse("@batch=inner :b!u@h QUIT :a.hub b.hub")
+    assert_true(irc.batch_stash(e2))
+    local stop = irc.parse("@batch=outer :irc.host BATCH -inner")
+    assert_true(irc.batch_stash(stop))
+    assert_equal(stop.batch, inner)
+    assert_equal(irc.batches["inner"], nil)
+
+    _assert_table_eq(outer.events, { e1, start, stop })
+    _assert_table_eq(inner.events, { e2 })
+
+    -- handling the nested BATCH events again, as part of the outer
+    -- batch, leaves the batches alone.
+    irc.handle(start); irc.handle(stop)
+    assert_equal(irc.batches["inner"], nil)
+    assert_equal(stop.batch, inner)
+
+    local done = irc.parse(":irc.host BATCH -outer")
+    irc.handle(done)
+    assert_equal(done.batch, outer)
+    assert_equal(irc.batches["outer"], nil)
+end
+
 function M.test_tags_no_value()
     local e = irc.parse("@testtag :team.tilde.chat NOTICE * :Hey")
     assert_true(e.tags.testtag)
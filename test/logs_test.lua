@@ -0,0 +1,70 @@
+local lunatest  = package.loaded.lunatest
+local assert_eq = lunatest.assert_equal
+
+-- lurchlog maps logs into memory (see logidx.c); this does the same
+-- with plain reads, which is all the tests need.
+package.loaded['lurchlog'] = {
+    size = function(path)
+        local f = io.open(path, "r")
+        if not f then return nil end
+        local sz = f:seek("end")
+        f:close()
+        return sz
+    end,
+    tail = function(path, n, limit)
+        local f = io.open(path, "r")
+        if not f then return nil end
+        local data = f:read("a")
+        f:close()
+        if limit then data = data:sub(1, limit) end
+
+        local lines = {}
+        for line in data:gmatch("([^\n]*)\n") do lines[#lines + 1] = line end
+        return { table.unpack(lines, math.max(1, #lines - n + 1)) }
+    end,
+}
+
+-- only used for lines without a time, which the tests don't log.
+package.loaded['lurchtime'] = package.loaded['lurchtime'] or {}
+
+local irc  = require('irc')
+local logs = require('logs')
+local M = {}
+
+local function msg(text)
+    return irc.parse(("@time=2021-06-01T12:00:00.000Z :bob!u@h PRIVMSG me :%s"):format(text))
+end
+
+function M.setup()
+    logs.logdir = os.tmpname()
+    os.remove(logs.logdir)
+    os.execute("mkdir -p " .. logs.logdir)
+end
+
+function M.teardown()
+    os.execute("rm -rf " .. logs.logdir)
+end
+
+-- a query buffer opened by an incoming message takes the size of its
+-- log as the backlog's cutoff before the message is logged (see
+-- prin_irc), so that the message isn't shown twice on first view.
+function M.test_new_query()
+    logs.append("bob", msg("yesterday"))
+
+    local cutoff = logs.size("bob")
+    logs.append("bob", msg("today"))
+
+    local backlog = logs.tail("bob", 10, cutoff)
+    assert_eq(#backlog, 1)
+    assert_eq(irc.parse(backlog[1]).msg, "yesterday")
+    assert_eq(#logs.tail("bob", 10), 2)
+end
+
+-- a query with no log has no backlog at all.
+function M.test_new_query_no_log()
+    assert_eq(logs.size("bob"), nil)
+    logs.append("bob", msg("hi"))
+    assert_eq(#logs.tail("bob", 10), 1)
+end
+
+return M
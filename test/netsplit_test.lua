@@ -0,0 +1,82 @@
+local lunatest  = package.loaded.lunatest
+local assert_eq = lunatest.assert_equal
+local assert_ye = lunatest.assert_true
+local assert_no = lunatest.assert_false
+
+local netsplit = require('netsplit')
+local M = {}
+
+local now = 0
+netsplit.clock = function() return now end
+
+function M.setup()
+    now = 0
+    netsplit.groups = {}
+    netsplit.split = {}
+end
+
+function M.test_servers()
+    assert_eq(netsplit.servers("irc.a.net irc.b.net"), "irc.a.net irc.b.net")
+    assert_eq(netsplit.servers("*.net *.split"), "*.net *.split")
+    assert_eq(netsplit.servers("Quit: irc.a.net irc.b.net"), nil)
+    assert_eq(netsplit.servers("bye bye"), nil)
+    assert_eq(netsplit.servers("irc..net irc.b.net"), nil)
+    assert_eq(netsplit.servers(".a.net irc.b.net"), nil)
+    assert_eq(netsplit.servers("irc.a.net irc.b.net."), nil)
+end
+
+function M.test_split()
+    local s = "irc.a.net irc.b.net"
+    netsplit.quit(s, "foo", { "#a", "#b" }, "e1")
+    now = 1
+    netsplit.quit(s, "bar", { "#b" }, "e2")
+    assert_ye(netsplit.pending())
+
+    -- not over until nobody has split for netsplit.window seconds.
+    now = 2
+    assert_eq(#netsplit.finished(), 0)
+
+    now = 3
+    local done = netsplit.finished()
+    assert_eq(#done, 1)
+    assert_no(netsplit.pending())
+
+    local g = done[1]
+    assert_eq(g.kind, "split")
+    assert_eq(g.servers, s)
+    assert_eq(g.order[1], "#a")
+    assert_eq(g.order[2], "#b")
+    assert_eq(#g.dests["#a"].nicks, 1)
+    assert_eq(g.dests["#b"].nicks[2], "bar")
+    assert_eq(g.dests["#b"].events[2], "e2")
+end
+
+function M.test_join()
+    local s = "irc.a.net irc.b.net"
+    assert_no(netsplit.join("foo", "#a", "e0"))
+
+    netsplit.quit(s, "foo", { "#a" }, "e1")
+    now = 5
+    netsplit.finished()
+
+    assert_ye(netsplit.join("foo", "#a", "e2"))
+    assert_no(netsplit.join("baz", "#a", "e3"))
+
+    now = 7
+    local done = netsplit.finished()
+    assert_eq(#done, 1)
+    assert_eq(done[1].kind, "join")
+    assert_eq(done[1].servers, s)
+    assert_eq(done[1].dests["#a"].nicks[1], "foo")
+
+    -- once they've returned, they aren't remembered anymore.
+    assert_no(netsplit.join("foo", "#b", "e4"))
+end
+
+function M.test_join_forgotten()
+    netsplit.quit("irc.a.net irc.b.net", "foo", { "#a" }, "e1")
+    now = netsplit.memory + 1
+    assert_no(netsplit.join("foo", "#a", "e2"))
+end
+
+return M
@@ -0,0 +1,92 @@
+local lunatest  = package.loaded.lunatest
+local assert_eq = lunatest.assert_equal
+local assert_ye = lunatest.assert_true
+
+local proc = require('proc')
+local lurchproc = require('lurchproc')
+local M = {}
+
+local now = 0
+proc.clock = function() return now end
+
+local spawned, killed, nextpid
+lurchproc.spawn = function(argv, _)
+    if argv[1] == "missing" then return nil, "missing: not found" end
+    nextpid = nextpid + 1
+    spawned[#spawned + 1] = nextpid
+    return nextpid
+end
+lurchproc.kill = function(pid, _)
+    killed[#killed + 1] = pid
+    return true
+end
+
+-- returns a callback that records the events it's called with.
+local function recorder()
+    local log = {}
+    return log, function(event, data)
+        log[#log + 1] = data ~= nil and (event .. " " .. tostring(data)) or event
+    end
+end
+
+function M.setup()
+    now = 0
+    spawned, killed, nextpid = {}, {}, 100
+    proc.running, proc.queue = {}, {}
+    proc.max = 2
+end
+
+function M.test_output()
+    local log, fn = recorder()
+    proc.spawn({ "echo" }, nil, fn)
+    proc.on_event(101, "stdout", "hello ")
+    proc.on_event(101, "stdout", "world\n")
+    proc.on_event(101, "exit", 0)
+    assert_eq(table.concat(log, "|"), "stdout hello |stdout world\n|exit 0")
+    assert_eq(next(proc.running), nil)
+end
+
+function M.test_lines()
+    local log, fn = recorder()
+    proc.spawn({ "cat" }, { lines = true }, fn)
+    proc.on_event(101, "stdout", "one\ntw")
+    proc.on_event(101, "stderr", "oops\n")
+    proc.on_event(101, "stdout", "o\n\nthree")
+    proc.on_event(101, "exit", 1)
+    assert_eq(table.concat(log, "|"),
+        "stdout one|stderr oops|stdout two|stdout |stdout three|exit 1")
+end
+
+function M.test_queue()
+    local log, fn = recorder()
+    for _ = 1, 3 do proc.spawn({ "sleep" }, nil, fn) end
+    assert_eq(#spawned, 2)
+    assert_eq(#proc.queue, 1)
+
+    -- the third starts once one of the first two is done.
+    proc.on_event(101, "exit", 0)
+    assert_eq(#spawned, 3)
+    assert_eq(#proc.queue, 0)
+    assert_ye(proc.running[103] ~= nil)
+end
+
+function M.test_timeout()
+    local log, fn = recorder()
+    proc.spawn({ "sleep" }, { timeout = 5 }, fn)
+    now = 4; proc.tick()
+    assert_eq(#killed, 0)
+    now = 5; proc.tick()
+    now = 6; proc.tick()
+    assert_eq(#killed, 1)
+    proc.on_event(101, "exit", 143)
+    assert_eq(table.concat(log, "|"), "timeout|exit 143")
+end
+
+function M.test_error()
+    local log, fn = recorder()
+    proc.spawn({ "missing" }, nil, fn)
+    assert_eq(table.concat(log, "|"), "error missing: not found")
+    assert_eq(next(proc.running), nil)
+end
+
+return M
@@ -0,0 +1,91 @@
+local lunatest  = package.loaded.lunatest
+local assert_eq = lunatest.assert_equal
+
+local statusline = require('statusline')
+local M = {}
+
+local bufs
+local renders
+
+local function newbuf(name)
+    return { name = name, pings = 0, unreadh = 0, unreadl = 0 }
+end
+
+local function segment(idx, buf, current)
+    renders = renders + 1
+    return string.format("%s%d:%s+%d,%d,%d ", current and "*" or "", idx,
+        buf.name, buf.pings, buf.unreadh, buf.unreadl)
+end
+
+local function render(cbuf)
+    renders = 0
+    return statusline.render(bufs, cbuf or 1, segment)
+end
+
+function M.setup()
+    statusline.invalidate()
+    bufs = { newbuf("<server>"), newbuf("#a"), newbuf("#b") }
+end
+
+function M.test_unchanged()
+    render()
+    assert_eq(renders, 3)
+
+    -- nothing has changed, so nothing is rendered again.
+    assert_eq(render(), "*1:<server>+0,0,0 2:#a+0,0,0 3:#b+0,0,0 ")
+    assert_eq(renders, 0)
+end
+
+function M.test_changed()
+    render()
+
+    bufs[2].unreadh = 1
+    assert_eq(render(), "*1:<server>+0,0,0 2:#a+0,1,0 3:#b+0,0,0 ")
+    assert_eq(renders, 1)
+
+    bufs[3].unreadl = 2
+    render(); assert_eq(renders, 1)
+
+    bufs[3].pings = 1
+    render(); assert_eq(renders, 1)
+
+    bufs[2].name = "#c"
+    assert_eq(render(), "*1:<server>+0,0,0 2:#c+0,1,0 3:#b+1,0,2 ")
+    assert_eq(renders, 1)
+
+    -- switching buffers changes both the old and new current ones.
+    assert_eq(render(3), "1:<server>+0,0,0 2:#c+0,1,0 *3:#b+1,0,2 ")
+    assert_eq(renders, 2)
+end
+
+function M.test_close()
+    render()
+
+    -- the buffers after the closed one move down.
+    table.remove(bufs, 2)
+    assert_eq(render(), "*1:<server>+0,0,0 2:#b+0,0,0 ")
+    assert_eq(renders, 1)
+
+    table.remove(bufs, 2)
+    assert_eq(render(), "*1:<server>+0,0,0 ")
+    assert_eq(renders, 0)
+end
+
+function M.test_render_fns()
+    local other = function(idx, _, _) return idx .. " " end
+    assert_eq(render(), "*1:<server>+0,0,0 2:#a+0,0,0 3:#b+0,0,0 ")
+
+    -- each render function has its own segments and line.
+    assert_eq(statusline.render(bufs, 1, other), "1 2 3 ")
+    assert_eq(render(), "*1:<server>+0,0,0 2:#a+0,0,0 3:#b+0,0,0 ")
+    assert_eq(renders, 0)
+end
+
+function M.test_invalidate()
+    render()
+    statusline.invalidate()
+    render()
+    assert_eq(renders, 3)
+end
+
+return M
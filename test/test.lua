@@ -8,6 +8,7 @@ package.path = ("%s/?.lua;"):format(dir) .. package.path
 package.preload['lurchconn'] = function() return {} end
 package.preload['termbox'] = function() return {} end
 package.preload['utf8utils'] = function() return {} end
+package.preload['lurchproc'] = function() return {} end
 
 local lunatest = require("lunatest")
 
@@ -15,5 +16,10 @@ lunatest.suite("irc_test")
 lunatest.suite("fun_test")
 lunatest.suite("util_test")
 lunatest.suite("mirc_test")
+lunatest.suite("netsplit_test")
+lunatest.suite("chanlist_test")
+lunatest.suite("proc_test")
+lunatest.suite("statusline_test")
+lunatest.suite("logs_test")
 
 lunatest.run()
@@ -0,0 +1,114 @@
+/*
+ * word wrapping for the right column of buffers (see tui.format_line).
+ *
+ * this is also used to work out how many rows each line of a buffer's
+ * history takes up on screen (see hist.c), so that scrolling can be
+ * done by rows; the two have to agree exactly, which is why both use
+ * this rather than each having their own.
+ *
+ * words are moved to the next row if they don't fit on the current
+ * one, and words that are wider than a whole row are broken wherever
+ * the row is full. spaces never cause a break by themselves, and line
+ * breaks in the text are kept. mIRC formatting takes up no space.
+ */
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <utf8proc.h>
+
+#include "dwidth.h"
+#include "mirc.h"
+#include "wrap.h"
+
+#define ISSPACE(CH) ((CH) == ' ' || (CH) == '\t')
+
+/* width of the character (or formatting code) at s[*pos], moving
+ * *pos past it. */
+static size_t
+cell(const char *s, size_t len, size_t *pos)
+{
+	size_t i = *pos;
+
+	switch (s[i]) {
+	break; case MIRC_COLOR:
+		/* up to two digits, and then maybe a comma and up to two
+		 * more, as in api_tb_writeline. */
+		++i;
+		for (size_t n = 0; n < 2 && i < len && isdigit((unsigned char) s[i]); ++n) ++i;
+		if (i + 1 < len && s[i] == ',' && isdigit((unsigned char) s[i + 1])) {
+			++i;
+			for (size_t n = 0; n < 2 && i < len && isdigit((unsigned char) s[i]); ++n) ++i;
+		}
+		*pos = i;
+		return 0;
+	break; case MIRC_256COLOR: case MIRC_256COLORBG:
+		*pos = i + 4 < len ? i + 4 : len;
+		return 0;
+	break; case MIRC_BOLD: case MIRC_UNDERLINE: case MIRC_ITALIC:
+	case MIRC_INVERT: case MIRC_BLINK: case MIRC_RESET:
+		*pos = i + 1;
+		return 0;
+	}
+
+	utf8proc_int32_t cp = 0;
+	utf8proc_ssize_t n = utf8proc_iterate((const utf8proc_uint8_t *) &s[i],
+		(utf8proc_ssize_t) (len - i), &cp);
+	if (n < 1) {
+		*pos = i + 1;
+		return 0;
+	}
+
+	*pos = i + n;
+	return cp >= 0 && cp < UTF8_MAX ? dwidth[cp] : 0;
+}
+
+/*
+ * wrap s to width columns, calling fn (if not NULL) with the offset of
+ * each place a row has to be broken that isn't already a line break.
+ * returns the number of rows s takes up.
+ */
+size_t
+wrap(const char *s, size_t len, size_t width, wrap_fn fn, void *ctx)
+{
+	if (width == 0) width = 1;
+
+	size_t rows = 1, col = 0;
+	for (size_t i = 0; i < len;) {
+		if (s[i] == '\n') {
+			++rows, col = 0, ++i;
+			continue;
+		}
+		if (ISSPACE(s[i])) {
+			++col, ++i;
+			continue;
+		}
+
+		size_t end = i, w = 0;
+		while (end < len && !ISSPACE(s[end]) && s[end] != '\n')
+			w += cell(s, len, &end);
+
+		if (col > 0 && col + w > width) {
+			if (fn) (fn)(i, ctx);
+			++rows, col = 0;
+		}
+
+		if (col + w <= width) {
+			col += w, i = end;
+			continue;
+		}
+
+		/* too wide to fit on a row of its own. */
+		while (i < end) {
+			size_t next = i;
+			size_t cw = cell(s, len, &next);
+			if (col > 0 && col + cw > width) {
+				if (fn) (fn)(i, ctx);
+				++rows, col = 0;
+			}
+			col += cw, i = next;
+		}
+	}
+
+	return rows;
+}
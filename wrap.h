@@ -0,0 +1,11 @@
+#ifndef WRAP_H
+#define WRAP_H
+
+#include <stddef.h>
+
+/* called for each place a line is broken at (a byte offset). */
+typedef void (*wrap_fn)(size_t at, void *ctx);
+
+size_t wrap(const char *s, size_t len, size_t width, wrap_fn fn, void *ctx);
+
+#endif